@@ -0,0 +1,1041 @@
+/*
+
+    Headless benchmarks for world generation, light,
+    meshing, block lookups, raycasts, player physics,
+    database, chunk pool and hashmap, CPU occlusion
+    culling.
+    Also checks that the mesher gives exactly the same
+    vertices as the simple block-by-block reference one
+    and that incremental light matches a full recompute,
+    exit code is 1 if not.
+
+    Usage: ccraft_bench [output.json]
+
+    Results are written as JSON to the given file, or
+    to stdout if no file is given. Progress goes to stderr.
+    Seed and settings are fixed, so numbers are comparable
+    between commits. No OpenGL context is ever created.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <config.h>
+#include <db.h>
+#include <hashmap.h>
+#include <time_measure.h>
+#include <worldgen.h>
+#include <noise_generator.h>
+#include <map/map.h>
+#include <map/chunk.h>
+#include <map/chunk_pool.h>
+#include <map/block.h>
+#include <map/light.h>
+#include <player/player_physics.h>
+#include <map/occlusion_culler.h>
+#include <map/cave_culler.h>
+#include <map/far_terrain.h>
+
+// Implemented in map.c
+HASHMAP_DECLARATION(Chunk*, chunks);
+
+#define BENCH_SEED          1337
+#define BENCH_MAX_RESULTS   64
+#define BENCH_BIOME_SEARCH  64
+
+typedef struct
+{
+    char name[64];
+    int iterations;
+    long ops_per_iteration;
+
+    double min_us;
+    double median_us;
+    double mean_us;
+    double max_us;
+}
+BenchResult;
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static int num_results = 0;
+
+static const char* biome_names[BIOMES_AMOUNT] =
+{
+    "plains", "forest", "flower_forest", "mountains", "desert", "ocean"
+};
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+// Takes per-iteration times in nanoseconds
+static void add_result(const char* name, double* times_ns, int iterations, long ops)
+{
+    if (num_results == BENCH_MAX_RESULTS)
+    {
+        fprintf(stderr, "Too many benchmark results, skipping %s\n", name);
+        return;
+    }
+
+    BenchResult* r = &results[num_results++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->iterations = iterations;
+    r->ops_per_iteration = ops;
+
+    qsort(times_ns, iterations, sizeof(double), compare_doubles);
+
+    double sum = 0.0;
+    for (int i = 0; i < iterations; i++)
+        sum += times_ns[i];
+
+    r->min_us    = times_ns[0] / 1000.0;
+    r->median_us = times_ns[iterations / 2] / 1000.0;
+    r->mean_us   = sum / iterations / 1000.0;
+    r->max_us    = times_ns[iterations - 1] / 1000.0;
+
+    fprintf(stderr, "%-40s median %12.2f us\n", r->name, r->median_us);
+}
+
+static void bench_chunk_reset(Chunk* c)
+{
+    memset(c->blocks, 0, CHUNK_WIDTH_REAL * CHUNK_WIDTH_REAL * CHUNK_HEIGHT_REAL);
+}
+
+static Chunk* bench_chunk_create(int cx, int cz)
+{
+    Chunk* c = chunk_init(cx, cz);
+    c->blocks = chunk_pool_acquire_buffer();
+    c->light = chunk_pool_acquire_buffer();
+    bench_chunk_reset(c);
+    memset(c->light, 0, CHUNK_WIDTH_REAL * CHUNK_WIDTH_REAL * CHUNK_HEIGHT_REAL);
+    return c;
+}
+
+// Shared by all meshes of benchmark, like buffers of one worker
+static ChunkMeshBuffers* mesh_buffers = NULL;
+
+// Mesh is left in mesh_buffers, like after upload
+static void bench_chunk_free_mesh(Chunk* c)
+{
+    c->generated_mesh_terrain = NULL;
+    c->generated_mesh_water = NULL;
+    c->generated_mesh_shadow = NULL;
+    c->generated_mesh_shadow_alpha = NULL;
+}
+
+// What chunk_upload_mesh_to_gpu() does besides uploading
+static void bench_chunk_apply_mesh_info(Chunk* c)
+{
+    c->min_y = c->generated_min_y;
+    c->max_y = c->generated_max_y;
+    c->opaque_slices = c->generated_opaque_slices;
+    memcpy(c->slice_connections, c->generated_slice_connections, 
+           sizeof(c->slice_connections));
+}
+
+// Straightforward mesher that reads all neighbours of every block,
+// chunk_generate_mesh() has to give exactly the same land and water
+static void reference_block_set_ao(Chunk* c, int x, int y, int z, float ao[6][4])
+{
+    // Same neighbour indices as in chunk.c
+    static const unsigned char lookup[6][4][3] = 
+    {
+        { { 0,  1,  9}, { 2,  1, 11}, {18,  9, 19}, {20, 19, 11} },
+        { { 6, 15,  7}, { 8, 17,  7}, {24, 25, 15}, {26, 17, 25} },
+        { {18, 19, 21}, {20, 19, 23}, {24, 21, 25}, {26, 23, 25} },
+        { { 0,  1,  3}, { 2,  1,  5}, { 6,  3,  7}, { 8,  5,  7} },
+        { { 0,  3,  9}, {18,  9, 21}, { 6,  3, 15}, {24, 15, 21} },
+        { { 2,  5, 11}, {20, 23, 11}, { 8,  5, 17}, {26, 17, 23} },
+    };
+    static const float curve[4] = { 0.0f, 0.33f, 0.66f, 1.0f };
+
+    unsigned char neighs[27];
+    int index = 0;
+    for (int dy = -1; dy <= 1; dy++)
+    for (int dx = -1; dx <= 1; dx++)
+    for (int dz = -1; dz <= 1; dz++)
+        neighs[index++] = c->blocks[XYZ(x + dx, y + dy, z + dz)];
+
+    for (int f = 0; f < 6; f++)
+    for (int v = 0; v < 4; v++)
+    {
+        int corner = block_is_transparent(neighs[lookup[f][v][0]]) ? 0 : 1;
+        int side1  = block_is_transparent(neighs[lookup[f][v][1]]) ? 0 : 1;
+        int side2  = block_is_transparent(neighs[lookup[f][v][2]]) ? 0 : 1;
+
+        ao[f][v] = side1 && side2 ? curve[3] : curve[corner + side1 + side2];
+    }
+}
+
+static void reference_generate_mesh(Chunk* c, Vertex* land, int* num_land, 
+                                    Vertex* water, int* num_water)
+{
+    static const int offsets[6][3] =
+    {
+        { -1,  0,  0 }, {  1,  0,  0 }, {  0,  1,  0 },
+        {  0, -1,  0 }, {  0,  0, -1 }, {  0,  0,  1 },
+    };
+
+    *num_land = 0;
+    *num_water = 0;
+
+    for (int x = 0; x < CHUNK_WIDTH; x++)
+    for (int y = 0; y < CHUNK_HEIGHT; y++)
+    for (int z = 0; z < CHUNK_WIDTH; z++)
+    {
+        unsigned char block = c->blocks[XYZ(x, y, z)];
+        if (block == BLOCK_AIR)
+            continue;
+
+        int faces[6];
+        int num_visible = 0;
+        for (int f = 0; f < 6; f++)
+        {
+            unsigned char neigh = c->blocks[XYZ(x + offsets[f][0], y + offsets[f][1], 
+                                                z + offsets[f][2])];
+            faces[f] = block_is_transparent(neigh) && block != neigh;
+            num_visible += faces[f];
+        }
+        if (num_visible == 0)
+            continue;
+
+        float ao[6][4];
+        reference_block_set_ao(c, x, y, z, ao);
+
+        unsigned char light[6];
+        for (int f = 0; f < 6; f++)
+            light[f] = c->light[XYZ(x + offsets[f][0], y + offsets[f][1], z + offsets[f][2])];
+
+        int const bx = x + c->x * CHUNK_WIDTH;
+        int const bz = z + c->z * CHUNK_WIDTH;
+
+        if (block == BLOCK_WATER)
+        {
+            int make_shorter = (c->blocks[XYZ(x, y + 1, z)] == BLOCK_AIR);
+            gen_cube_vertices(water, num_water, bx, y, bz, block, BLOCK_SIZE, 
+                              make_shorter, faces, ao, light);
+        }
+        else if (block_is_plant(block))
+        {
+            gen_plant_vertices(land, num_land, bx, y, bz, block, BLOCK_SIZE, 
+                               c->light[XYZ(x, y, z)]);
+        }
+        else
+        {
+            gen_cube_vertices(land, num_land, bx, y, bz, block, BLOCK_SIZE, 0, 
+                              faces, ao, light);
+        }
+    }
+}
+
+// Field by field, padding of Vertex is never written
+static int vertices_are_equal(Vertex* a, Vertex* b, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (memcmp(a[i].pos, b[i].pos, sizeof(a[i].pos)) ||
+            memcmp(a[i].tex_coord, b[i].tex_coord, sizeof(a[i].tex_coord)) ||
+            memcmp(&a[i].ao, &b[i].ao, sizeof(a[i].ao)) ||
+            a[i].tile != b[i].tile || a[i].normal != b[i].normal ||
+            a[i].light != b[i].light)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int mesh_mismatches = 0;
+
+static void bench_reference_mesh(Chunk* c, const char* biome_name)
+{
+    int const iterations = 20;
+    double* times = malloc(iterations * sizeof(double));
+    char name[64];
+
+    size_t const max_vertices = (size_t)CHUNK_WIDTH * CHUNK_WIDTH * CHUNK_HEIGHT * 36;
+    Vertex* land = malloc(max_vertices * sizeof(Vertex));
+    Vertex* water = malloc(max_vertices * sizeof(Vertex));
+    int num_land, num_water;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t start = time_get_ns();
+        reference_generate_mesh(c, land, &num_land, water, &num_water);
+        times[i] = (double)(time_get_ns() - start);
+    }
+    snprintf(name, sizeof(name), "reference_mesh/%s", biome_name);
+    add_result(name, times, iterations, 1);
+
+    c->lod = 0;
+    chunk_generate_mesh(c, mesh_buffers);
+
+    int const is_equal = 
+        c->vertex_land_count == (size_t)num_land && c->vertex_water_count == (size_t)num_water &&
+        vertices_are_equal(c->generated_mesh_terrain, land, num_land) &&
+        vertices_are_equal(c->generated_mesh_water, water, num_water);
+
+    fprintf(stderr, "%s: mesh is %s to reference\n", name, is_equal ? "identical" : "NOT identical");
+    mesh_mismatches += !is_equal;
+
+    bench_chunk_free_mesh(c);
+    free(land);
+    free(water);
+    free(times);
+}
+
+#define BENCH_LIGHT_EDITS 8
+
+static int light_mismatches = 0;
+
+// Same sequence on every run
+static uint32_t bench_random()
+{
+    static uint32_t state = 2463534242u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Batches of random edits around the surface: glowstone, air
+// and stone. After each one incremental light has to be exactly
+// the same as light computed from scratch
+static void bench_light_update(Chunk* c, const char* biome_name)
+{
+    int const iterations = 50;
+    double* times = malloc(iterations * sizeof(double));
+    char name[64];
+
+    static const unsigned char edit_blocks[3] = { BLOCK_GLOWSTONE, BLOCK_AIR, BLOCK_STONE };
+
+    size_t const size = (size_t)CHUNK_WIDTH_REAL * CHUNK_WIDTH_REAL * CHUNK_HEIGHT_REAL;
+    unsigned char* updated = malloc(size);
+    Chunk* neighs[9] = { NULL };
+    int edits[BENCH_LIGHT_EDITS];
+    int is_equal = 1;
+
+    light_compute(c);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        for (int e = 0; e < BENCH_LIGHT_EDITS; e++)
+        {
+            int const x = bench_random() % CHUNK_WIDTH;
+            int const z = bench_random() % CHUNK_WIDTH;
+            int surface = CHUNK_HEIGHT - 1;
+            while (surface > 0 && block_is_transparent(c->blocks[XYZ(x, surface, z)]))
+                surface--;
+
+            int const y = MAX(0, MIN(CHUNK_HEIGHT - 1, surface - 8 + (int)(bench_random() % 12)));
+            edits[e] = XYZ(x, y, z);
+            c->blocks[edits[e]] = edit_blocks[bench_random() % 3];
+        }
+
+        uint64_t start = time_get_ns();
+        light_update(c, neighs, edits, BENCH_LIGHT_EDITS);
+        times[i] = (double)(time_get_ns() - start);
+
+        memcpy(updated, c->light, size);
+        light_compute(c);
+        is_equal = is_equal && memcmp(updated, c->light, size) == 0;
+    }
+
+    snprintf(name, sizeof(name), "light_update/%s", biome_name);
+    add_result(name, times, iterations, BENCH_LIGHT_EDITS);
+
+    fprintf(stderr, "%s: light is %s to full recompute\n", name, 
+            is_equal ? "identical" : "NOT identical");
+    light_mismatches += !is_equal;
+
+    free(updated);
+    free(times);
+}
+
+// Chunk is considered representative if its center
+// and all 4 corners are in the same biome
+static int is_chunk_in_biome(int cx, int cz, Biome biome)
+{
+    int const x0 = cx * CHUNK_WIDTH;
+    int const z0 = cz * CHUNK_WIDTH;
+    int const w = CHUNK_WIDTH - 1;
+
+    return worldgen_get_biome(x0 + w / 2, z0 + w / 2) == biome
+        && worldgen_get_biome(x0,         z0)         == biome
+        && worldgen_get_biome(x0 + w,     z0)         == biome
+        && worldgen_get_biome(x0,         z0 + w)     == biome
+        && worldgen_get_biome(x0 + w,     z0 + w)     == biome;
+}
+
+// Search in growing squares around (0, 0), so the result
+// is always the same for the same seed
+static int find_chunk_with_biome(Biome biome, int* res_cx, int* res_cz)
+{
+    for (int r = 0; r < BENCH_BIOME_SEARCH; r++)
+    for (int cx = -r; cx <= r; cx++)
+    for (int cz = -r; cz <= r; cz++)
+    {
+        if (abs(cx) != r && abs(cz) != r)
+            continue;
+
+        if (is_chunk_in_biome(cx, cz, biome))
+        {
+            *res_cx = cx;
+            *res_cz = cz;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void bench_worldgen_and_mesh(Biome biome, int cx, int cz)
+{
+    int const iterations = 20;
+    double* times = malloc(iterations * sizeof(double));
+    char name[64];
+
+    Chunk* c = bench_chunk_create(cx, cz);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        bench_chunk_reset(c);
+
+        uint64_t start = time_get_ns();
+        worldgen_generate_chunk(c);
+        times[i] = (double)(time_get_ns() - start);
+    }
+    snprintf(name, sizeof(name), "worldgen_generate_chunk/%s", biome_names[biome]);
+    add_result(name, times, iterations, 1);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t start = time_get_ns();
+        light_compute(c);
+        times[i] = (double)(time_get_ns() - start);
+    }
+    snprintf(name, sizeof(name), "light_compute/%s", biome_names[biome]);
+    add_result(name, times, iterations, 1);
+
+    for (int lod = 0; lod <= CHUNK_MAX_LOD; lod++)
+    {
+        c->lod = lod;
+        for (int i = 0; i < iterations; i++)
+        {
+            uint64_t start = time_get_ns();
+            chunk_generate_mesh(c, mesh_buffers);
+            times[i] = (double)(time_get_ns() - start);
+
+            bench_chunk_free_mesh(c);
+        }
+
+        if (lod == 0)
+            snprintf(name, sizeof(name), "chunk_generate_mesh/%s", biome_names[biome]);
+        else
+            snprintf(name, sizeof(name), "chunk_generate_mesh_lod%d/%s", lod, biome_names[biome]);
+        add_result(name, times, iterations, 1);
+
+        fprintf(stderr, "%s: %zu land and %zu water vertices\n", 
+                name, c->vertex_land_count, c->vertex_water_count);
+        fprintf(stderr, "%s: %zu shadow (%zu bytes) and %zu alpha tested shadow vertices\n", 
+                name, c->vertex_shadow_count, c->vertex_shadow_count * 3 * sizeof(float),
+                c->vertex_shadow_alpha_count);
+    }
+
+    bench_reference_mesh(c, biome_names[biome]);
+    bench_light_update(c, biome_names[biome]);
+
+    chunk_delete(c);
+    free(times);
+}
+
+// Far terrain tile of one chunk needs this many samples
+static void bench_worldgen_get_surface()
+{
+    int const iterations = 20;
+    int const quads = MAX(1, CHUNK_WIDTH / FAR_TERRAIN_STEP);
+    int const samples = (quads + 1) * (quads + 1);
+    int const step = CHUNK_WIDTH / quads;
+    double* times = malloc(iterations * sizeof(double));
+
+    volatile int sink = 0;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        int sum = 0;
+
+        uint64_t start = time_get_ns();
+        for (int x = 0; x <= quads; x++)
+        for (int z = 0; z <= quads; z++)
+        {
+            int height;
+            unsigned char block;
+            worldgen_get_surface((i * 7 + x) * step, (i * 3 + z) * step, &height, &block);
+            sum += height + block;
+        }
+        times[i] = (double)(time_get_ns() - start);
+
+        sink += sum;
+    }
+    (void)sink;
+
+    add_result("worldgen_get_surface_tile", times, iterations, samples);
+    free(times);
+}
+
+static void bench_map_get_block()
+{
+    int const iterations = 20;
+    int const lookups = 1000000;
+    double* times = malloc(iterations * sizeof(double));
+
+    // Loads 3x3 chunks around (0, 0)
+    map_force_chunks_near_player((vec3){ 0.0f, 0.0f, 0.0f });
+
+    unsigned rand_value = BENCH_SEED;
+    int* coords = malloc(3 * lookups * sizeof(int));
+    for (int i = 0; i < lookups; i++)
+    {
+        coords[3 * i + 0] = (int)(my_rand(&rand_value) % (3 * CHUNK_WIDTH)) - CHUNK_WIDTH;
+        coords[3 * i + 1] = (int)(my_rand(&rand_value) % CHUNK_HEIGHT);
+        coords[3 * i + 2] = (int)(my_rand(&rand_value) % (3 * CHUNK_WIDTH)) - CHUNK_WIDTH;
+    }
+
+    // Prevent compiler from throwing lookups away
+    volatile unsigned sink = 0;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        unsigned sum = 0;
+
+        uint64_t start = time_get_ns();
+        for (int j = 0; j < lookups; j++)
+            sum += map_get_block(coords[3 * j], coords[3 * j + 1], coords[3 * j + 2]);
+        times[i] = (double)(time_get_ns() - start);
+
+        sink += sum;
+    }
+    add_result("map_get_block", times, iterations, lookups);
+
+    (void)sink;
+    free(coords);
+    free(times);
+}
+
+static void bench_map_raycast()
+{
+    int const iterations = 20;
+    int const rays = 100000;
+    double* times = malloc(iterations * sizeof(double));
+
+    // Rays start a bit above ground of 3x3 chunks around (0, 0)
+    unsigned rand_value = BENCH_SEED;
+    float* origins = malloc(3 * rays * sizeof(float));
+    float* dirs = malloc(3 * rays * sizeof(float));
+    for (int i = 0; i < rays; i++)
+    {
+        int const x = (int)(my_rand(&rand_value) % (3 * CHUNK_WIDTH)) - CHUNK_WIDTH;
+        int const z = (int)(my_rand(&rand_value) % (3 * CHUNK_WIDTH)) - CHUNK_WIDTH;
+        origins[3 * i + 0] = (x + 0.5f) * BLOCK_SIZE;
+        origins[3 * i + 1] = (map_get_highest_block(x, z) + 2.7f) * BLOCK_SIZE;
+        origins[3 * i + 2] = (z + 0.5f) * BLOCK_SIZE;
+
+        vec3 dir;
+        for (int j = 0; j < 3; j++)
+            dir[j] = (float)(my_rand(&rand_value) % 2001) / 1000.0f - 1.0f;
+        dir[1] -= 0.5f;
+        glm_vec3_normalize(dir);
+        memcpy(&dirs[3 * i], dir, sizeof(vec3));
+    }
+
+    int num_hits = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        num_hits = 0;
+
+        uint64_t start = time_get_ns();
+        for (int j = 0; j < rays; j++)
+        {
+            MapRaycastHit hit;
+            num_hits += map_raycast(&origins[3 * j], &dirs[3 * j], 
+                                    BLOCK_BREAK_RADIUS * BLOCK_SIZE, &hit);
+        }
+        times[i] = (double)(time_get_ns() - start);
+    }
+    add_result("map_raycast", times, iterations, rays);
+    fprintf(stderr, "map_raycast: %d of %d rays hit a block\n", num_hits, rays);
+
+    free(origins);
+    free(dirs);
+    free(times);
+}
+
+// Single call of player_collide_with_map() that falls from
+// given height onto ground, like a frame at high fall speed
+static void bench_player_physics(int fall_blocks)
+{
+    int const iterations = 20;
+    int const calls = 10000;
+    double* times = malloc(iterations * sizeof(double));
+    char name[64];
+
+    int const bx = CHUNK_WIDTH / 2;
+    int const bz = CHUNK_WIDTH / 2;
+    float const start_y = (map_get_highest_block(bx, bz) + 1 + fall_blocks + 1.625f) * BLOCK_SIZE;
+    vec3 motion = { 0.1f * BLOCK_SIZE, -(fall_blocks + 0.5f) * BLOCK_SIZE, 0.1f * BLOCK_SIZE };
+
+    // Whole fall happens in one tick, like with high max_fall_speed
+    float const max_fall_speed = MAX_FALL_SPEED;
+    MAX_FALL_SPEED = MAX(MAX_FALL_SPEED, -motion[1] * SIMULATION_RATE);
+
+    Player p;
+    memset(&p, 0, sizeof(p));
+
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t start = time_get_ns();
+        for (int j = 0; j < calls; j++)
+        {
+            my_glm_vec3_set(p.pos, (bx + 0.5f) * BLOCK_SIZE, start_y, (bz + 0.5f) * BLOCK_SIZE);
+            my_glm_vec3_set(p.speed, motion[0], motion[1], motion[2]);
+            player_collide_with_map(&p, motion);
+        }
+        times[i] = (double)(time_get_ns() - start);
+    }
+    snprintf(name, sizeof(name), "player_collide_with_map/fall_%d", fall_blocks);
+    add_result(name, times, iterations, calls);
+    fprintf(stderr, "%s: on ground %d\n", name, p.on_ground);
+
+    MAX_FALL_SPEED = max_fall_speed;
+
+    free(times);
+}
+
+static void bench_db()
+{
+    int const iterations = 20;
+    int const blocks = CHUNK_WIDTH * CHUNK_WIDTH;
+    double* times = malloc(iterations * sizeof(double));
+
+    // Far away from chunks used by other benchmarks
+    int const cz = 100000;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t start = time_get_ns();
+        for (int x = 0; x < CHUNK_WIDTH; x++)
+        for (int z = 0; z < CHUNK_WIDTH; z++)
+            db_insert_block(i, cz, x, 100, z, BLOCK_BRICKS);
+        times[i] = (double)(time_get_ns() - start);
+    }
+    add_result("db_insert_block", times, iterations, blocks);
+
+    Chunk* c = bench_chunk_create(0, cz);
+    for (int i = 0; i < iterations; i++)
+    {
+        c->x = i;
+
+        uint64_t start = time_get_ns();
+        db_get_blocks_for_chunk(c);
+        times[i] = (double)(time_get_ns() - start);
+    }
+    add_result("db_get_blocks_for_chunk", times, iterations, blocks);
+
+    chunk_delete(c);
+    free(times);
+}
+
+// Ring of chunks is loaded and unloaded again and again like at
+// the edge of load radius. After the first round pool has enough
+// buffers, so amount of them must not grow anymore
+static void bench_chunk_pool()
+{
+    int const iterations = 50;
+    int const amount = 8 * CHUNK_UNLOAD_RADIUS;
+    double* times = malloc(iterations * sizeof(double));
+    Chunk** chunks = malloc(amount * sizeof(Chunk*));
+
+    ChunkPoolStats before;
+    for (int i = 0; i < iterations; i++)
+    {
+        if (i == 1)
+            chunk_pool_get_stats(&before);
+
+        uint64_t start = time_get_ns();
+        for (int j = 0; j < amount; j++)
+            chunks[j] = bench_chunk_create(j, i);
+        for (int j = 0; j < amount; j++)
+            chunk_delete(chunks[j]);
+        times[i] = (double)(time_get_ns() - start);
+    }
+    add_result("chunk_pool_load_unload", times, iterations, amount);
+
+    ChunkPoolStats after;
+    chunk_pool_get_stats(&after);
+    fprintf(stderr, "chunk_pool: %d buffers after the first round, %d after %d rounds, "
+            "%d of %d slots at peak, %d overflow chunks kept\n", before.num_buffers, 
+            after.num_buffers, iterations, after.peak_used, after.capacity, 
+            after.num_free_overflow);
+
+    free(chunks);
+    free(times);
+}
+
+static void bench_hashmap()
+{
+    int const iterations = 50;
+    int const side = 2 * CHUNK_UNLOAD_RADIUS + 1;
+    int const amount = side * side;
+    double* times_insert   = malloc(iterations * sizeof(double));
+    double* times_contains = malloc(iterations * sizeof(double));
+    double* times_remove   = malloc(iterations * sizeof(double));
+
+    Chunk* chunks = malloc(amount * sizeof(Chunk));
+    for (int i = 0; i < amount; i++)
+    {
+        chunks[i].x = i / side - CHUNK_UNLOAD_RADIUS;
+        chunks[i].z = i % side - CHUNK_UNLOAD_RADIUS;
+    }
+
+    volatile int sink = 0;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        // Same size as in map_init()
+        HashMap_chunks* hm = hashmap_chunks_create(CHUNK_RENDER_RADIUS2 * 1.2f);
+
+        uint64_t start = time_get_ns();
+        for (int j = 0; j < amount; j++)
+            hashmap_chunks_insert(hm, &chunks[j]);
+        times_insert[i] = (double)(time_get_ns() - start);
+
+        int found = 0;
+        start = time_get_ns();
+        for (int j = 0; j < amount; j++)
+            found += hashmap_chunks_contains(hm, &chunks[j]);
+        times_contains[i] = (double)(time_get_ns() - start);
+        sink += found;
+
+        start = time_get_ns();
+        for (int j = 0; j < amount; j++)
+            hashmap_chunks_remove(hm, &chunks[j]);
+        times_remove[i] = (double)(time_get_ns() - start);
+
+        hashmap_chunks_delete(hm);
+        free(hm);
+    }
+
+    add_result("hashmap_chunks_insert",   times_insert,   iterations, amount);
+    add_result("hashmap_chunks_contains", times_contains, iterations, amount);
+    add_result("hashmap_chunks_remove",   times_remove,   iterations, amount);
+
+    (void)sink;
+    free(chunks);
+    free(times_insert);
+    free(times_contains);
+    free(times_remove);
+}
+
+// Square of generated and meshed chunks around (0, 0)
+#define BENCH_AREA_RADIUS 6
+#define BENCH_AREA_SIDE   (2 * BENCH_AREA_RADIUS + 1)
+
+static Chunk* bench_area[BENCH_AREA_SIDE * BENCH_AREA_SIDE];
+
+static void bench_area_create()
+{
+    for (int i = 0; i < BENCH_AREA_SIDE * BENCH_AREA_SIDE; i++)
+    {
+        Chunk* c = bench_chunk_create(i / BENCH_AREA_SIDE - BENCH_AREA_RADIUS, 
+                                      i % BENCH_AREA_SIDE - BENCH_AREA_RADIUS);
+        worldgen_generate_chunk(c);
+        light_compute(c);
+        chunk_generate_mesh(c, mesh_buffers);
+        bench_chunk_free_mesh(c);
+        bench_chunk_apply_mesh_info(c);
+        bench_area[i] = c;
+    }
+}
+
+static Chunk* bench_area_get_chunk(int cx, int cz)
+{
+    if (abs(cx) > BENCH_AREA_RADIUS || abs(cz) > BENCH_AREA_RADIUS)
+        return NULL;
+    return bench_area[(cx + BENCH_AREA_RADIUS) * BENCH_AREA_SIDE + cz + BENCH_AREA_RADIUS];
+}
+
+static void bench_area_free()
+{
+    for (int i = 0; i < BENCH_AREA_SIDE * BENCH_AREA_SIDE; i++)
+        chunk_delete(bench_area[i]);
+}
+
+// Camera is in the middle of generated area, given amount of 
+// blocks above the ground, and looks along x axis
+static void bench_camera(float height, vec3 cam_pos, mat4 vp, vec4 planes[6])
+{
+    Chunk* center = bench_area_get_chunk(0, 0);
+    int ground = CHUNK_HEIGHT - 1;
+    while (ground > 0 && center->blocks[XYZ(0, ground, 0)] == BLOCK_AIR)
+        ground--;
+
+    glm_vec3_copy((vec3){ 0.5f * BLOCK_SIZE, (ground + height) * BLOCK_SIZE, 0.5f * BLOCK_SIZE }, cam_pos);
+
+    mat4 view, proj;
+    glm_look(cam_pos, (vec3){ 1.0f, 0.0f, 0.0f }, (vec3){ 0.0f, 1.0f, 0.0f }, view);
+    glm_perspective(glm_rad(FOV), 16.0f / 9.0f, BLOCK_SIZE / 10.0f, BENCH_AREA_SIDE * CHUNK_SIZE, proj);
+    glm_mat4_mul(proj, view, vp);
+    glm_frustum_planes(vp, planes);
+}
+
+// Camera stands on the ground, like in map_update()
+static void bench_occlusion_culler()
+{
+    int const iterations = 50;
+    double* times = malloc(iterations * sizeof(double));
+
+    vec3 cam_pos;
+    mat4 vp;
+    vec4 planes[6];
+    bench_camera(1.7f, cam_pos, vp, planes);
+
+    OcclusionCuller* oc = occlusion_culler_create(0);
+    int num_culled = 0;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t start = time_get_ns();
+
+        occlusion_culler_reset(oc, vp);
+        for (int j = 0; j < BENCH_AREA_SIDE * BENCH_AREA_SIDE; j++)
+        {
+            Chunk* c = bench_area[j];
+            if (!chunk_mesh_is_visible(c, planes))
+                continue;
+
+            vec3 boxes[CHUNK_MAX_SLICES][2];
+            int num_boxes = chunk_get_occluders(c, boxes);
+            for (int k = 0; k < num_boxes; k++)
+                occlusion_culler_add_occluder(oc, boxes[k]);
+
+            vec3 aabb[2];
+            chunk_get_mesh_aabb(c, aabb);
+            occlusion_culler_add_object(oc, aabb);
+        }
+        occlusion_culler_start(oc);
+        occlusion_culler_wait(oc);
+
+        times[i] = (double)(time_get_ns() - start);
+
+        num_culled = 0;
+        for (int j = 0; j < oc->num_objects; j++)
+            num_culled += !occlusion_culler_is_visible(oc, j);
+    }
+
+    fprintf(stderr, "occlusion_culler: %d of %d chunks in frustum are occluded\n", 
+            num_culled, oc->num_objects);
+    add_result("occlusion_culler", times, iterations, oc->num_objects);
+
+    occlusion_culler_destroy(oc);
+    free(times);
+}
+
+static int occlusion_failures = 0;
+
+// Camera is in the origin and looks along x axis, wall is
+// a 4x4 occluder 5 units in front of it. NULL wall means none
+static int occlusion_test_box(OcclusionCuller* oc, vec3 wall[2], vec3 box[2])
+{
+    mat4 view, proj, vp;
+    glm_look((vec3){ 0.0f, 0.0f, 0.0f }, (vec3){ 1.0f, 0.0f, 0.0f }, (vec3){ 0.0f, 1.0f, 0.0f }, view);
+    glm_perspective(glm_rad(90.0f), 2.0f, 0.1f, 100.0f, proj);
+    glm_mat4_mul(proj, view, vp);
+
+    occlusion_culler_reset(oc, vp);
+    if (wall)
+        occlusion_culler_add_occluder(oc, wall);
+    int id = occlusion_culler_add_object(oc, box);
+    occlusion_culler_start(oc);
+    occlusion_culler_wait(oc);
+
+    return occlusion_culler_is_visible(oc, id);
+}
+
+// Known answers for single boxes, on caller's thread and on its own
+static void bench_occlusion_culler_cases()
+{
+    static const struct 
+    { 
+        const char* name; 
+        int has_wall; 
+        vec3 box[2]; 
+        int is_visible; 
+    } 
+    cases[] =
+    {
+        { "behind wall",        1, { { 10.0f, -1.0f, -1.0f }, { 11.0f, 1.0f, 1.0f } }, 0 },
+        { "no wall",            0, { { 10.0f, -1.0f, -1.0f }, { 11.0f, 1.0f, 1.0f } }, 1 },
+        { "crosses near plane", 1, { { -1.0f,  0.2f, -1.0f }, { 11.0f, 1.0f, 1.0f } }, 1 },
+        { "partly beside wall", 1, { { 10.0f, -1.0f,  3.0f }, { 11.0f, 1.0f, 5.0f } }, 1 },
+    };
+
+    vec3 wall[2] = { { 5.0f, -2.0f, -2.0f }, { 6.0f, 2.0f, 2.0f } };
+
+    for (int use_thread = 0; use_thread <= 1; use_thread++)
+    {
+        OcclusionCuller* oc = occlusion_culler_create(use_thread);
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        {
+            vec3 box[2];
+            glm_vec3_copy((float*)cases[i].box[0], box[0]);
+            glm_vec3_copy((float*)cases[i].box[1], box[1]);
+
+            int is_visible = occlusion_test_box(oc, cases[i].has_wall ? wall : NULL, box);
+            if (is_visible != cases[i].is_visible)
+            {
+                fprintf(stderr, "occlusion_culler: box '%s' is %s, expected %s%s\n", 
+                        cases[i].name, is_visible ? "visible" : "hidden",
+                        cases[i].is_visible ? "visible" : "hidden",
+                        use_thread ? " (thread)" : "");
+                occlusion_failures++;
+            }
+        }
+        occlusion_culler_destroy(oc);
+    }
+
+    fprintf(stderr, "occlusion_culler: %s\n", occlusion_failures ? 
+            "known cases FAILED" : "all known cases passed");
+}
+
+// On the ground and deep underground, where 
+// most of chunks should be culled
+static void bench_cave_culler()
+{
+    static const struct { const char* name; float height; } cases[] =
+    {
+        { "cave_culler_surface",     1.7f  },
+        { "cave_culler_underground", -40.0f },
+    };
+
+    int const iterations = 50;
+    double* times = malloc(iterations * sizeof(double));
+    CaveCuller* cc = cave_culler_create();
+
+    for (int k = 0; k < (int)(sizeof(cases) / sizeof(cases[0])); k++)
+    {
+        vec3 cam_pos;
+        mat4 vp;
+        vec4 planes[6];
+        bench_camera(cases[k].height, cam_pos, vp, planes);
+
+        for (int i = 0; i < iterations; i++)
+        {
+            uint64_t start = time_get_ns();
+            cave_culler_run(cc, cam_pos, planes, BENCH_AREA_RADIUS, bench_area_get_chunk);
+            times[i] = (double)(time_get_ns() - start);
+        }
+
+        int num_in_frustum = 0, num_visible = 0;
+        for (int j = 0; j < BENCH_AREA_SIDE * BENCH_AREA_SIDE; j++)
+        {
+            if (chunk_mesh_is_visible(bench_area[j], planes))
+            {
+                num_in_frustum++;
+                num_visible += bench_area[j]->is_cave_visible;
+            }
+        }
+
+        fprintf(stderr, "%s: %d of %d chunks in frustum are reached, %d slices visited\n", 
+                cases[k].name, num_visible, num_in_frustum, cc->num_visited);
+        add_result(cases[k].name, times, iterations, cc->num_visited);
+    }
+
+    cave_culler_destroy(cc);
+    free(times);
+}
+
+static void write_json(FILE* f)
+{
+    fprintf(f, "{\n");
+    fprintf(f, "  \"seed\": %d,\n", BENCH_SEED);
+    fprintf(f, "  \"chunk_width\": %d,\n", CHUNK_WIDTH);
+    fprintf(f, "  \"chunk_height\": %d,\n", CHUNK_HEIGHT);
+    fprintf(f, "  \"benchmarks\": [\n");
+
+    for (int i = 0; i < num_results; i++)
+    {
+        BenchResult* r = &results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"iterations\": %d, \"ops_per_iteration\": %ld, "
+                   "\"min_us\": %.3f, \"median_us\": %.3f, \"mean_us\": %.3f, \"max_us\": %.3f, "
+                   "\"median_ns_per_op\": %.3f}%s\n",
+                r->name, r->iterations, r->ops_per_iteration,
+                r->min_us, r->median_us, r->mean_us, r->max_us,
+                r->median_us * 1000.0 / r->ops_per_iteration,
+                i == num_results - 1 ? "" : ",");
+    }
+
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+}
+
+int main(int argc, const char** argv)
+{
+    // Default settings from config.c are used on purpose,
+    // so local config.ini doesn't affect results
+    db_init(":memory:");
+    map_init_headless(BENCH_SEED);
+    mesh_buffers = chunk_mesh_buffers_create();
+
+    for (int b = 0; b < BIOMES_AMOUNT; b++)
+    {
+        int cx, cz;
+        if (!find_chunk_with_biome(b, &cx, &cz))
+        {
+            fprintf(stderr, "No chunk with biome '%s' was found, skipping\n", biome_names[b]);
+            continue;
+        }
+        bench_worldgen_and_mesh(b, cx, cz);
+    }
+
+    bench_worldgen_get_surface();
+    bench_map_get_block();
+    bench_map_raycast();
+    bench_player_physics(1);
+    bench_player_physics(40);
+    bench_db();
+    bench_chunk_pool();
+    bench_hashmap();
+
+    bench_occlusion_culler_cases();
+
+    bench_area_create();
+    bench_occlusion_culler();
+    bench_cave_culler();
+    bench_area_free();
+
+    FILE* out = stdout;
+    if (argc >= 2)
+    {
+        out = fopen(argv[1], "w");
+        if (!out)
+        {
+            fprintf(stderr, "Unable to open output file: %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    write_json(out);
+    if (out != stdout)
+        fclose(out);
+
+    chunk_mesh_buffers_destroy(mesh_buffers);
+    map_free();
+    db_free();
+
+    return (mesh_mismatches || light_mismatches || occlusion_failures) ? EXIT_FAILURE : 0;
+}
@@ -6,25 +6,16 @@ in float v_ao;
 flat in uint v_tile;
 in float v_fog_amount;
 in vec3 v_normal;
+in float v_sky_light;
+in float v_block_light;
 
 out vec4 out_color;
 
 uniform sampler2DArray texture_sampler;
-uniform float block_light;
-uniform vec3 fog_color;
 
 // =================================
-in vec4 v_near_shadowmap_coord;
-in vec4 v_far_shadowmap_coord;
-uniform sampler2DShadow u_near_shadowmap;
-uniform sampler2DShadow u_far_shadowmap;
-uniform vec3  u_light_dir;
-uniform float u_near_shadow_dist;
-uniform float u_shadow_blend_dist;
-uniform vec3 u_player_pos;
-uniform mat4 u_near_light_matrix;
-uniform mat4 u_far_light_matrix;
-uniform float u_shadow_multiplier;
+// Layer i is cascade i, the nearest one is 0
+uniform sampler2DArrayShadow u_shadowmaps;
 // =================================
 
 vec2 poisson_disk[16] = vec2[]( 
@@ -53,25 +44,56 @@ float random(vec3 seed, int i){
 	return fract(sin(dot_product) * 43758.5453);
 }
 
-float calculate_shadow(vec4 shadowmap_coord, sampler2DShadow shadowmap, float disk_dividor)
+// Coordinates of fragment in shadow map of cascade, z is depth
+vec3 get_cascade_coords(int cascade)
 {
-    vec3 proj_coords = shadowmap_coord.xyz / shadowmap_coord.w;
-    proj_coords = (proj_coords + 1.0) / 2.0;
+    vec4 coords = u_shadowmap_mats[cascade] * vec4(v_pos, 1.0);
+    return (coords.xyz / coords.w + 1.0) / 2.0;
+}
 
+float calculate_shadow(vec3 proj_coords, int cascade)
+{
     if (proj_coords.z > 1.0)
         return 0.0;
 
+    // Poisson disk has the same size in texels in every cascade
+    float disk_dividor = float(textureSize(u_shadowmaps, 0).x) * 1.25;
+
     float shadow_factor = 0.0;
     for (int i = 0; i < 9; i++) 
     {
         int index = int(16.0 * random(vec3(v_tile, v_normal.y, v_ao), i)) % 16;
-        shadow_factor += texture(shadowmap, vec3(proj_coords.xy + poisson_disk[index] / disk_dividor, proj_coords.z));
+        vec2 uv = proj_coords.xy + poisson_disk[index] / disk_dividor;
+        shadow_factor += texture(u_shadowmaps, vec4(uv, float(cascade), proj_coords.z));
     }
     shadow_factor /= 9.0;
 
     return 1.0 - shadow_factor;
 }
 
+// The first cascade that contains fragment is the most detailed one.
+// Close to its border it's blended with the next cascade
+float calculate_cascaded_shadow()
+{
+    for (int i = 0; i < u_shadow_cascades; i++)
+    {
+        vec3 coords = get_cascade_coords(i);
+        float border_dist = min(min(coords.x, coords.y), min(1.0 - coords.x, 1.0 - coords.y));
+        if (border_dist <= 0.0)
+            continue;
+
+        float shadow = calculate_shadow(coords, i);
+        if (border_dist >= u_shadow_blend_dist || i == u_shadow_cascades - 1)
+            return shadow;
+
+        vec3 next_coords = get_cascade_coords(i + 1);
+        float shadow_next = calculate_shadow(next_coords, i + 1);
+        return mix(shadow_next, shadow, border_dist / u_shadow_blend_dist);
+    }
+
+    return 0.0;
+}
+
 void main()
 {    
     vec4 color = texture(texture_sampler, vec3(v_texcoord, v_tile));
@@ -87,24 +109,7 @@ void main()
     }
     else
     {
-        float frag_dist = distance(u_player_pos, v_pos);
-
-        if (frag_dist < u_near_shadow_dist - u_shadow_blend_dist)
-        {
-            shadow_factor = calculate_shadow(v_near_shadowmap_coord, u_near_shadowmap, 3000.0);
-        }
-        else if (frag_dist > u_near_shadow_dist + u_shadow_blend_dist)
-        {
-            shadow_factor = calculate_shadow(v_far_shadowmap_coord, u_far_shadowmap, 1500.0);
-        }
-        else
-        {
-            float shadow_near = calculate_shadow(v_near_shadowmap_coord, u_near_shadowmap, 3000.0);
-            float shadow_far  = calculate_shadow(v_far_shadowmap_coord,  u_far_shadowmap,  1500.0);
-
-            float mix_factor = (frag_dist - (u_near_shadow_dist - u_shadow_blend_dist)) / (2 * u_shadow_blend_dist);
-            shadow_factor = mix(shadow_near, shadow_far, mix_factor);
-        }
+        shadow_factor = calculate_cascaded_shadow();
     }
 
     // Smooth shadowing on small angles
@@ -119,9 +124,14 @@ void main()
     color.a += shadow_factor / 3.0;
 
     color.rgb -= 0.35 * v_ao;
-    color.rgb *= block_light;
 
-    color.rgb = mix(color.rgb, fog_color, v_fog_amount);
+    // Every level of light is 80% of the next one, so even complete
+    // darkness is a bit lit. Sky follows time of day, blocks don't
+    float sky = u_block_light * pow(0.8, 15.0 * (1.0 - v_sky_light));
+    float block = pow(0.8, 15.0 * (1.0 - v_block_light));
+    color.rgb *= max(sky, block);
+
+    color.rgb = mix(color.rgb, u_fog_color, v_fog_amount);
 
     out_color = color;
 }
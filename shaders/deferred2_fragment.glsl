@@ -11,15 +11,8 @@ uniform sampler2D texture_ui;
 uniform sampler2D texture_depth;
 
 uniform int  u_motion_blur_enabled;
-uniform mat4 u_projection_inv_matrix;
-uniform mat4 u_view_inv_matrix;
-uniform mat4 u_prev_view_matrix;
-uniform mat4 u_projection_matrix;
-uniform vec3 u_cam_pos;
-uniform vec3 u_prev_cam_pos;
 uniform float u_strength;
 uniform int u_samples;
-uniform float u_dt;
 
 uniform float u_gamma;
 uniform float u_saturation;
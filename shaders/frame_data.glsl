@@ -0,0 +1,25 @@
+// Per-frame data shared by all shader programs,
+// must match FrameData struct in src/shader.h.
+// SHADOW_MAX_CASCADES is defined by shader loader
+layout (std140) uniform FrameData
+{
+    mat4  u_vp_matrix;
+    mat4  u_projection_matrix;
+    mat4  u_projection_inv_matrix;
+    mat4  u_view_inv_matrix;
+    mat4  u_prev_view_matrix;
+    mat4  u_shadowmap_mats[SHADOW_MAX_CASCADES];
+
+    vec3  u_cam_pos;
+    float u_time;
+    vec3  u_prev_cam_pos;
+    float u_dt;
+    vec3  u_light_dir;
+    float u_fog_dist;
+    vec3  u_fog_color;
+    float u_block_light;
+
+    float u_shadow_multiplier;
+    int   u_shadow_cascades;
+    float u_shadow_blend_dist;
+};
@@ -6,7 +6,6 @@ flat in uint v_tile;
 out vec4 out_color;
 
 uniform sampler2DArray texture_sampler;
-uniform float block_light;
 
 void main()
 {    
@@ -14,5 +13,5 @@ void main()
     if (color.a < 0.5)
         discard;
     
-    out_color = vec4(color.rgb * block_light, color.a);
+    out_color = vec4(color.rgb * u_block_light, color.a);
 }
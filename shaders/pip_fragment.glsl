@@ -4,10 +4,11 @@ in vec2 v_texcoord;
 
 out vec4 out_color;
 
-uniform sampler2D u_texture;
+uniform sampler2DArray u_texture;
+uniform int u_layer;
 
 void main()
 {      
-    float tex_color = texture(u_texture, v_texcoord).r;
+    float tex_color = texture(u_texture, vec3(v_texcoord, u_layer)).r;
     out_color = vec4(vec3(tex_color), 1.0);
 }
@@ -0,0 +1,11 @@
+#version 330 core
+
+layout (location = 0) in vec3 a_pos;
+
+// Index of cascade, 0 is the nearest one
+uniform int u_cascade;
+
+void main()
+{
+    gl_Position = u_shadowmap_mats[u_cascade] * vec4(a_pos, 1.0);
+}
@@ -9,11 +9,12 @@ layout (location = 4) in uint a_normal;
 out vec2 v_texcoord;
 flat out uint v_tile;
 
-uniform mat4 mvp_matrix;
+// Index of cascade, 0 is the nearest one
+uniform int u_cascade;
 
 void main()
 {
-    gl_Position = mvp_matrix * vec4(a_pos, 1.0);
+    gl_Position = u_shadowmap_mats[u_cascade] * vec4(a_pos, 1.0);
     v_texcoord = a_texcoord;
     v_tile = a_tile;
 }
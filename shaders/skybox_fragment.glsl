@@ -10,14 +10,11 @@ uniform samplerCube texture_day;
 uniform samplerCube texture_evening;
 uniform samplerCube texture_night;
 
-uniform float time;
 uniform float day_to_evn_start;
 uniform float evn_to_night_start;
 uniform float night_start;
 uniform float night_to_day_start;
 
-uniform vec3 fog_color;
-
 void main()
 {      
     vec4 day = texture(texture_day, v_texcoord);
@@ -25,12 +22,12 @@ void main()
     vec4 night = texture(texture_night, v_texcoord_night);
 
     // Blend different skyboxes according to current time
-    if (time < evn_to_night_start)
-        out_color = mix(day, evening, smoothstep(day_to_evn_start, evn_to_night_start, time));
-    else if (time < night_to_day_start)
-        out_color = mix(evening, night, smoothstep(evn_to_night_start, night_start, time));
+    if (u_time < evn_to_night_start)
+        out_color = mix(day, evening, smoothstep(day_to_evn_start, evn_to_night_start, u_time));
+    else if (u_time < night_to_day_start)
+        out_color = mix(evening, night, smoothstep(evn_to_night_start, night_start, u_time));
     else
-        out_color = mix(night, day, smoothstep(night_to_day_start, 1.0, time));
+        out_color = mix(night, day, smoothstep(night_to_day_start, 1.0, u_time));
     
     vec3 dir_point    = normalize(v_pos);
     vec3 proj_to_xz   = normalize(vec3(dir_point.x, 0.0, dir_point.z));
@@ -42,5 +39,5 @@ void main()
     if (v_pos.y < 0.0)
         fog_amount = 1;
 
-    out_color = mix(out_color, vec4(fog_color, 1.0), fog_amount);
+    out_color = mix(out_color, vec4(u_fog_color, 1.0), fog_amount);
 }
@@ -7,7 +7,6 @@ out vec3 v_texcoord_night;
 out vec3 v_pos;
 
 uniform mat4 mvp_matrix;
-uniform float time;
 
 #define PI 3.1415926535
 #define COS60 0.5
@@ -20,8 +19,8 @@ void main()
     v_texcoord = a_pos;
     v_pos = a_pos;
 
-    float sint = sin(2 * PI * time);
-    float cost = cos(2 * PI * time);
+    float sint = sin(2 * PI * u_time);
+    float cost = cos(2 * PI * u_time);
 
     // Rotate only night texture;
     // This is 2 rotation matrices combined to one, it rotates
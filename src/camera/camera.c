@@ -34,7 +34,7 @@ Camera* camera_create(vec3 pos, float pitch, float yaw, vec3 front)
     cam->sens = MOUSE_SENS;
 
     cam->clip_near = BLOCK_SIZE / 10.0f;
-    cam->clip_far = MAX((CHUNK_RENDER_RADIUS * 1.2f) * CHUNK_SIZE,
+    cam->clip_far = MAX((MAX(CHUNK_RENDER_RADIUS, FAR_TERRAIN_RADIUS) * 1.2f) * CHUNK_SIZE,
                         512 * BLOCK_SIZE);
     cam->aspect_ratio = (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT;
 
@@ -10,7 +10,16 @@
 
 // [GRAPHICS] (default values)
 int   CHUNK_RENDER_RADIUS      = 16;
+int   LOD_DISTANCE_1           = 10;
+int   LOD_DISTANCE_2           = 20;
+int   FAR_TERRAIN_RADIUS       = 64;
 int   ANISOTROPIC_FILTER_LEVEL = 16;
+int   OCCLUSION_CULLING        = 1;
+int   CPU_OCCLUSION_CULLING    = 1;
+int   CAVE_CULLING             = 1;
+int   SHADOW_CASCADES          = 4;
+int   SHADOW_CACHING           = 1;
+int   SHADOW_FAR_INTERVAL      = 8;
 int   MOTION_BLUR_ENABLED      = 1;
 float MOTION_BLUR_STRENGTH     = 0.0005f;
 int   MOTION_BLUR_SAMPLES      = 7;
@@ -42,10 +51,18 @@ float       EVENING_LIGHT      = 0.5f;
 float       NIGHT_LIGHT        = 0.15f;
 
 // [CORE] (default values)
-int   NUM_WORKERS  = 0;
-int   CHUNK_WIDTH  = 32;
-int   CHUNK_HEIGHT = 256;
-float BLOCK_SIZE   = 0.1f;
+int   NUM_WORKERS       = 0;
+int   CHUNK_WIDTH       = 32;
+int   CHUNK_HEIGHT      = 256;
+float BLOCK_SIZE        = 0.1f;
+int   PROFILER_ENABLED  = 0;
+int   GPU_TIMER_ENABLED = 0;
+int   SIMULATION_RATE   = 60;
+int   MAP_UPDATE_RATE   = 60;
+float CHUNK_UNLOAD_DELAY     = 10.0f;
+float CHUNK_PREFETCH_TIME    = 2.0f;
+int   CHUNK_PREFETCH_WORKERS = 1;
+int   CHUNK_PREFETCH_MESH    = 0;
 
 // [PHYSICS] (default values)
 float MAX_RUN_SPEED           = 5.612f;
@@ -75,7 +92,6 @@ int   CHUNK_LOAD_RADIUS             = 16 + 2;
 int   CHUNK_LOAD_RADIUS2            = (16 + 2) * (16 + 2);
 int   CHUNK_UNLOAD_RADIUS           = 16 + 5;
 int   CHUNK_UNLOAD_RADIUS2          = (16 + 5) * (16 + 5);
-int   BLOCK_BREAK_RADIUS2           = 5 * 5;
 int   CHUNK_RENDER_RADIUS2          = 16 * 16;
 int   CHUNK_WIDTH_REAL              = 32 + 2;
 int   CHUNK_HEIGHT_REAL             = 256 + 2;
@@ -99,10 +115,41 @@ static void create_default_cfg_file(const char* config_path)
     "; High performance hit\n"
     "chunk_render_radius = 8\n\n"
 
+    "; Chunks further than this are built from 2x2x2\n"
+    "; and 4x4x4 merged blocks, 0 disables level\n"
+    "lod_distance_1 = 10\n"
+    "lod_distance_2 = 20\n\n"
+
+    "; Low performance hit, coarse terrain without\n"
+    "; blocks up to this radius, 0 disables it\n"
+    "far_terrain_radius = 32\n\n"
+
     "; Very low performance hit, huge\n"
     "; image quality boost\n"
     "anisotropic_filter_level = 16\n\n"
 
+    "; Don't render chunks hidden behind terrain,\n"
+    "; e.g. caves and valleys behind mountains\n"
+    "occlusion_culling = 1\n\n"
+
+    "; Same, but done on CPU using only fully solid\n"
+    "; parts of chunks, helps mostly underground\n"
+    "cpu_occlusion_culling = 1\n\n"
+
+    "; Don't render chunks that can't be seen through\n"
+    "; caves and open space from camera position\n"
+    "cave_culling = 1\n\n"
+
+    "; Amount of shadow maps, each covers a part of view\n"
+    "; distance, further ones are bigger. From 1 to 4\n"
+    "shadow_cascades = 4\n\n"
+
+    "; Re-render shadows only if sun moved, player moved\n"
+    "; or chunks changed. Far shadows are updated at\n"
+    "; most once in this amount of frames\n"
+    "shadow_caching      = 1\n"
+    "shadow_far_interval = 8\n\n"
+
     "; Low performance hit if amount\n"
     "; of samples is moderate\n"
     "motion_blur_enabled  = 1\n"
@@ -159,6 +206,41 @@ static void create_default_cfg_file(const char* config_path)
     "; start to experience there errors not far from spawn\n"
     "block_size = 0.1\n\n"
 
+    "; Record timings of frame stages and chunk loading.\n"
+    "; Press F3 to save them to trace file, open it in\n"
+    "; chrome://tracing. Trace is also saved on exit\n"
+    "profiler_enabled = 0\n\n"
+
+    "; Measure GPU time of every render pass. Averages\n"
+    "; are shown in window title and printed to stdout\n"
+    "gpu_timer_enabled = 0\n\n"
+
+    "; Player physics runs this many fixed ticks per second,\n"
+    "; rendered frames are interpolated between ticks\n"
+    "simulation_rate = 60\n\n"
+
+    "; Chunk loading, unloading and meshing are scheduled\n"
+    "; this many times per second, whatever FPS is\n"
+    "map_update_rate = 60\n\n"
+
+    "; Seconds that chunk stays loaded after it left unload\n"
+    "; radius, so going back and forth over its border\n"
+    "; doesn't generate the same chunks again and again\n"
+    "chunk_unload_delay = 10\n\n"
+
+    "; Seconds of player movement that are predicted from\n"
+    "; its velocity. Chunks on the way are generated before\n"
+    "; they get into load radius. Set to 0 to disable\n"
+    "chunk_prefetch_time = 2\n\n"
+
+    "; At most this many workers prefetch chunks at once,\n"
+    "; at least one is always left for chunks around player\n"
+    "chunk_prefetch_workers = 1\n\n"
+
+    "; Mesh prefetched chunks too, otherwise only their\n"
+    "; terrain is generated until they're in load radius\n"
+    "chunk_prefetch_mesh = 0\n\n"
+
     "[PHYSICS]\n"
     "; Blocks per second\n"
     "max_run_speed    = 5.612\n"
@@ -252,7 +334,16 @@ void config_load(const char* config_path)
     }
 
     try_load(cfg, "GRAPHICS", "chunk_render_radius", "%d", &CHUNK_RENDER_RADIUS);
+    try_load(cfg, "GRAPHICS", "lod_distance_1", "%d", &LOD_DISTANCE_1);
+    try_load(cfg, "GRAPHICS", "lod_distance_2", "%d", &LOD_DISTANCE_2);
+    try_load(cfg, "GRAPHICS", "far_terrain_radius", "%d", &FAR_TERRAIN_RADIUS);
     try_load(cfg, "GRAPHICS", "anisotropic_filter_level", "%d", &ANISOTROPIC_FILTER_LEVEL);
+    try_load(cfg, "GRAPHICS", "occlusion_culling", "%d", &OCCLUSION_CULLING);
+    try_load(cfg, "GRAPHICS", "cpu_occlusion_culling", "%d", &CPU_OCCLUSION_CULLING);
+    try_load(cfg, "GRAPHICS", "cave_culling", "%d", &CAVE_CULLING);
+    try_load(cfg, "GRAPHICS", "shadow_cascades", "%d", &SHADOW_CASCADES);
+    try_load(cfg, "GRAPHICS", "shadow_caching", "%d", &SHADOW_CACHING);
+    try_load(cfg, "GRAPHICS", "shadow_far_interval", "%d", &SHADOW_FAR_INTERVAL);
     try_load(cfg, "GRAPHICS", "motion_blur_enabled", "%d", &MOTION_BLUR_ENABLED);
     try_load(cfg, "GRAPHICS", "motion_blur_strength", "%f", &MOTION_BLUR_STRENGTH);
     try_load(cfg, "GRAPHICS", "motion_blur_samples", "%d", &MOTION_BLUR_SAMPLES);
@@ -285,6 +376,14 @@ void config_load(const char* config_path)
     try_load(cfg, "CORE", "chunk_width", "%d", &CHUNK_WIDTH);
     try_load(cfg, "CORE", "chunk_height", "%d", &CHUNK_HEIGHT);
     try_load(cfg, "CORE", "block_size", "%f", &BLOCK_SIZE);
+    try_load(cfg, "CORE", "profiler_enabled", "%d", &PROFILER_ENABLED);
+    try_load(cfg, "CORE", "gpu_timer_enabled", "%d", &GPU_TIMER_ENABLED);
+    try_load(cfg, "CORE", "simulation_rate", "%d", &SIMULATION_RATE);
+    try_load(cfg, "CORE", "map_update_rate", "%d", &MAP_UPDATE_RATE);
+    try_load(cfg, "CORE", "chunk_unload_delay", "%f", &CHUNK_UNLOAD_DELAY);
+    try_load(cfg, "CORE", "chunk_prefetch_time", "%f", &CHUNK_PREFETCH_TIME);
+    try_load(cfg, "CORE", "chunk_prefetch_workers", "%d", &CHUNK_PREFETCH_WORKERS);
+    try_load(cfg, "CORE", "chunk_prefetch_mesh", "%d", &CHUNK_PREFETCH_MESH);
 
     try_load(cfg, "PHYSICS", "max_run_speed", "%f", &MAX_RUN_SPEED);
     try_load(cfg, "PHYSICS", "max_move_speed", "%f", &MAX_MOVE_SPEED);
@@ -303,11 +402,17 @@ void config_load(const char* config_path)
 
     normalize_player_physics();
 
+    SHADOW_CASCADES = MAX(1, MIN(SHADOW_CASCADES, SHADOW_MAX_CASCADES));
+    SIMULATION_RATE = MAX(1, SIMULATION_RATE);
+    MAP_UPDATE_RATE = MAX(1, MAP_UPDATE_RATE);
+    CHUNK_UNLOAD_DELAY = MAX(0.0f, CHUNK_UNLOAD_DELAY);
+    CHUNK_PREFETCH_TIME = MAX(0.0f, CHUNK_PREFETCH_TIME);
+    CHUNK_PREFETCH_WORKERS = MAX(0, CHUNK_PREFETCH_WORKERS);
+
     CHUNK_SIZE          = (float)CHUNK_WIDTH * BLOCK_SIZE;
     CHUNK_LOAD_RADIUS   = CHUNK_RENDER_RADIUS + 2;
     CHUNK_UNLOAD_RADIUS = CHUNK_RENDER_RADIUS + 5;
 
-    BLOCK_BREAK_RADIUS2  = BLOCK_BREAK_RADIUS  * BLOCK_BREAK_RADIUS;
     CHUNK_RENDER_RADIUS2 = CHUNK_RENDER_RADIUS * CHUNK_RENDER_RADIUS;
     CHUNK_LOAD_RADIUS2   = CHUNK_LOAD_RADIUS   * CHUNK_LOAD_RADIUS;
     CHUNK_UNLOAD_RADIUS2 = CHUNK_UNLOAD_RADIUS * CHUNK_UNLOAD_RADIUS;
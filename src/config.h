@@ -1,9 +1,21 @@
 #ifndef CONFIG_H_
 #define CONFIG_H_
 
+// Shadow cascades are limited by frame data layout
+#define SHADOW_MAX_CASCADES 4
+
 // [GRAPHICS]
 extern int   CHUNK_RENDER_RADIUS;
+extern int   LOD_DISTANCE_1;
+extern int   LOD_DISTANCE_2;
+extern int   FAR_TERRAIN_RADIUS;
 extern int   ANISOTROPIC_FILTER_LEVEL;
+extern int   OCCLUSION_CULLING;
+extern int   CPU_OCCLUSION_CULLING;
+extern int   CAVE_CULLING;
+extern int   SHADOW_CASCADES;
+extern int   SHADOW_CACHING;
+extern int   SHADOW_FAR_INTERVAL;
 extern int   MOTION_BLUR_ENABLED;
 extern float MOTION_BLUR_STRENGTH;
 extern int   MOTION_BLUR_SAMPLES;
@@ -39,6 +51,14 @@ extern int NUM_WORKERS;
 extern int CHUNK_WIDTH;
 extern int CHUNK_HEIGHT;
 extern float BLOCK_SIZE;
+extern int PROFILER_ENABLED;
+extern int GPU_TIMER_ENABLED;
+extern int SIMULATION_RATE;
+extern int MAP_UPDATE_RATE;
+extern float CHUNK_UNLOAD_DELAY;
+extern float CHUNK_PREFETCH_TIME;
+extern int CHUNK_PREFETCH_WORKERS;
+extern int CHUNK_PREFETCH_MESH;
 
 // [PHYSICS]
 extern float MAX_RUN_SPEED;
@@ -68,7 +88,6 @@ extern int   CHUNK_LOAD_RADIUS;
 extern int   CHUNK_LOAD_RADIUS2;
 extern int   CHUNK_UNLOAD_RADIUS;
 extern int   CHUNK_UNLOAD_RADIUS2;
-extern int   BLOCK_BREAK_RADIUS2;
 extern int   CHUNK_RENDER_RADIUS2;
 extern int   CHUNK_WIDTH_REAL;
 extern int   CHUNK_HEIGHT_REAL;
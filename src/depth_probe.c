@@ -0,0 +1,78 @@
+#include <depth_probe.h>
+
+#include <stddef.h>
+
+#include <glad/glad.h>
+
+#define DEPTH_PROBE_BUFFERS 3
+
+typedef struct
+{
+    GLuint pbo;
+    GLsync fence;
+}
+DepthProbeBuffer;
+
+static DepthProbeBuffer buffers[DEPTH_PROBE_BUFFERS];
+static int next_buffer = 0;
+
+void depth_probe_init()
+{
+    for (int i = 0; i < DEPTH_PROBE_BUFFERS; i++)
+    {
+        glGenBuffers(1, &buffers[i].pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i].pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float), NULL, GL_STREAM_READ);
+        buffers[i].fence = NULL;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+int depth_probe_read(int x, int y, float* depth)
+{
+    int is_updated = 0;
+
+    // Take the newest finished result. Buffers are checked
+    // from the oldest one, so later ones overwrite it
+    for (int i = 0; i < DEPTH_PROBE_BUFFERS; i++)
+    {
+        DepthProbeBuffer* buf = &buffers[(next_buffer + i) % DEPTH_PROBE_BUFFERS];
+        if (!buf->fence)
+            continue;
+
+        if (glClientWaitSync(buf->fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            continue;
+
+        glDeleteSync(buf->fence);
+        buf->fence = NULL;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buf->pbo);
+        glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, sizeof(float), depth);
+        is_updated = 1;
+    }
+
+    // If the oldest buffer is still busy, the GPU is too far
+    // behind. Skip this request instead of waiting for it
+    DepthProbeBuffer* buf = &buffers[next_buffer];
+    if (!buf->fence)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buf->pbo);
+        glReadPixels(x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        buf->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        next_buffer = (next_buffer + 1) % DEPTH_PROBE_BUFFERS;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return is_updated;
+}
+
+void depth_probe_free()
+{
+    for (int i = 0; i < DEPTH_PROBE_BUFFERS; i++)
+    {
+        if (buffers[i].fence)
+            glDeleteSync(buffers[i].fence);
+        glDeleteBuffers(1, &buffers[i].pbo);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef DEPTH_PROBE_H_
+#define DEPTH_PROBE_H_
+
+// Asynchronous readback of a single depth value. Every call
+// starts reading depth at (x, y) of the currently bound read
+// framebuffer into a pixel buffer object and returns the newest
+// value the GPU has already finished with, usually the one
+// requested a frame or two earlier. The CPU never waits for
+// the GPU, unlike plain glReadPixels.
+void depth_probe_init();
+
+// Returns 1 and writes to *depth if a new value became
+// available, otherwise *depth is left untouched
+int depth_probe_read(int x, int y, float* depth);
+
+void depth_probe_free();
+
+#endif
@@ -0,0 +1,100 @@
+#include <frame_arena.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <utils.h>
+
+#define FRAME_ARENA_ALIGNMENT 16
+
+// Allocation that didn't fit, freed on reset
+typedef struct FrameArenaOverflow
+{
+    struct FrameArenaOverflow* next;
+}
+FrameArenaOverflow;
+
+static struct
+{
+    unsigned char* data;
+    size_t capacity;
+    size_t used;
+
+    FrameArenaOverflow* overflow;
+    size_t overflow_size;
+}
+arena;
+
+static size_t align_size(size_t size)
+{
+    return (size + FRAME_ARENA_ALIGNMENT - 1) & ~(size_t)(FRAME_ARENA_ALIGNMENT - 1);
+}
+
+static void free_overflow()
+{
+    while (arena.overflow)
+    {
+        FrameArenaOverflow* next = arena.overflow->next;
+        free(arena.overflow);
+        arena.overflow = next;
+    }
+}
+
+void frame_arena_init(size_t capacity)
+{
+    frame_arena_free();
+
+    arena.capacity = align_size(capacity);
+    arena.data = malloc(arena.capacity);
+    if (!arena.data)
+    {
+        fprintf(stderr, "Unable to allocate frame arena of %zu bytes\n", arena.capacity);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void* frame_arena_alloc(size_t size)
+{
+    size = align_size(MAX(size, 1));
+
+    if (arena.used + size <= arena.capacity)
+    {
+        void* ptr = arena.data + arena.used;
+        arena.used += size;
+        return ptr;
+    }
+
+    // Header is padded, so memory after it stays aligned
+    size_t const header = align_size(sizeof(FrameArenaOverflow));
+    FrameArenaOverflow* block = malloc(header + size);
+    block->next = arena.overflow;
+    arena.overflow = block;
+    arena.overflow_size += size;
+
+    return (unsigned char*)block + header;
+}
+
+void frame_arena_reset()
+{
+    if (arena.overflow)
+    {
+        free_overflow();
+
+        // Room for the whole last frame and some more
+        size_t const needed = arena.used + arena.overflow_size;
+        frame_arena_init(needed + needed / 2);
+    }
+
+    arena.used = 0;
+    arena.overflow_size = 0;
+}
+
+void frame_arena_free()
+{
+    free_overflow();
+    free(arena.data);
+    arena.data = NULL;
+    arena.capacity = 0;
+    arena.used = 0;
+    arena.overflow_size = 0;
+}
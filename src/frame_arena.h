@@ -0,0 +1,27 @@
+#ifndef FRAME_ARENA_H_
+#define FRAME_ARENA_H_
+
+#include <stddef.h>
+
+// Memory for data that lives until the end of frame, main thread
+// only. Allocation is a pointer bump, there's nothing to free, all
+// of it is released at once by frame_arena_reset() at the start of
+// the next frame. When frame needs more than capacity, the rest is
+// malloc'ed and arena grows on reset, so it settles to no malloc
+// at all after a few frames.
+//
+// frame_arena_reset();
+// Chunk** chunks = frame_arena_alloc(n * sizeof(Chunk*));
+//     ...
+
+// Capacity in bytes, it's fine to allocate without init
+void frame_arena_init(size_t capacity);
+
+// Memory is aligned for any type
+void* frame_arena_alloc(size_t size);
+
+void frame_arena_reset();
+
+void frame_arena_free();
+
+#endif
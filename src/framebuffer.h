@@ -7,8 +7,7 @@ typedef enum
 {
     FBTYPE_DEFAULT,
     FBTYPE_TEXTURE,
-    FBTYPE_SHADOW_NEAR,
-    FBTYPE_SHADOW_FAR
+    FBTYPE_SHADOW
 }
 FbType;
 
@@ -33,13 +32,9 @@ typedef struct
     GLuint gbuf_tex_color_pass_1;
     GLuint gbuf_tex_depth;
 
-    GLuint gbuf_shadow_near;
-    GLuint gbuf_shadow_near_map;
-    int near_shadowmap_w;
-
-    GLuint gbuf_shadow_far;
-    GLuint gbuf_shadow_far_map;
-    int far_shadowmap_w;
+    GLuint gbuf_shadow;
+    GLuint gbuf_shadow_maps;
+    int shadowmap_w;
 }
 Framebuffers;
 
@@ -51,6 +46,9 @@ void framebuffers_destroy(Framebuffers* fb);
 
 void framebuffer_use(Framebuffers* fb, FbType type);
 
+// Bind shadow framebuffer with layer of given cascade as depth
+void framebuffer_use_shadowmap(Framebuffers* fb, int cascade);
+
 void framebuffer_use_texture(FbTextureType type);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include <gpu_timer.h>
+
+#include <stdio.h>
+
+#include <glad/glad.h>
+
+#include <config.h>
+
+// Results are read this many frames after the queries
+// were issued, by then the GPU is usually done with them
+#define GPU_TIMER_FRAMES 3
+
+static const char* pass_names[GPU_PASSES_AMOUNT] =
+{
+    "shadow near", "shadow far", "game", "dof", "post"
+};
+
+static GLuint queries[GPU_TIMER_FRAMES][GPU_PASSES_AMOUNT];
+static int is_issued[GPU_TIMER_FRAMES][GPU_PASSES_AMOUNT];
+static int curr_frame = 0;
+static int is_measuring = 0;
+
+static GLuint64 sum_ns[GPU_PASSES_AMOUNT];
+static int num_samples[GPU_PASSES_AMOUNT];
+
+void gpu_timer_init()
+{
+    if (!GPU_TIMER_ENABLED)
+        return;
+
+    glGenQueries(GPU_TIMER_FRAMES * GPU_PASSES_AMOUNT, &queries[0][0]);
+}
+
+void gpu_timer_on_new_frame()
+{
+    if (!GPU_TIMER_ENABLED)
+        return;
+
+    curr_frame = (curr_frame + 1) % GPU_TIMER_FRAMES;
+
+    // Collect results of the oldest frame before its
+    // queries are reused. Results that are still not
+    // ready are dropped instead of waiting for them
+    for (int i = 0; i < GPU_PASSES_AMOUNT; i++)
+    {
+        if (!is_issued[curr_frame][i])
+            continue;
+        is_issued[curr_frame][i] = 0;
+
+        GLuint is_available = 0;
+        glGetQueryObjectuiv(queries[curr_frame][i], GL_QUERY_RESULT_AVAILABLE, &is_available);
+        if (!is_available)
+            continue;
+
+        GLuint64 elapsed_ns;
+        glGetQueryObjectui64v(queries[curr_frame][i], GL_QUERY_RESULT, &elapsed_ns);
+        sum_ns[i] += elapsed_ns;
+        num_samples[i]++;
+    }
+}
+
+void gpu_timer_begin(GpuPass pass)
+{
+    if (!GPU_TIMER_ENABLED || is_measuring)
+        return;
+
+    glBeginQuery(GL_TIME_ELAPSED, queries[curr_frame][pass]);
+    is_issued[curr_frame][pass] = 1;
+    is_measuring = 1;
+}
+
+void gpu_timer_end()
+{
+    if (!is_measuring)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    is_measuring = 0;
+}
+
+void gpu_timer_update_averages(char* buf, size_t buf_size)
+{
+    if (buf_size)
+        buf[0] = '\0';
+
+    if (!GPU_TIMER_ENABLED)
+        return;
+
+    char summary[256];
+    int len = 0;
+    float total_ms = 0.0f;
+
+    for (int i = 0; i < GPU_PASSES_AMOUNT; i++)
+    {
+        float avg_ms = num_samples[i] ? sum_ns[i] / 1e6f / num_samples[i] : 0.0f;
+        total_ms += avg_ms;
+
+        len += sprintf(summary + len, "%s %.2f, ", pass_names[i], avg_ms);
+
+        sum_ns[i] = 0;
+        num_samples[i] = 0;
+    }
+    sprintf(summary + len, "total %.2f", total_ms);
+
+    fprintf(stdout, "GPU ms: %s\n", summary);
+    snprintf(buf, buf_size, " | GPU ms: %s", summary);
+}
+
+void gpu_timer_free()
+{
+    if (!GPU_TIMER_ENABLED)
+        return;
+
+    glDeleteQueries(GPU_TIMER_FRAMES * GPU_PASSES_AMOUNT, &queries[0][0]);
+}
@@ -0,0 +1,42 @@
+#ifndef GPU_TIMER_H_
+#define GPU_TIMER_H_
+
+#include <stddef.h>
+
+typedef enum
+{
+    GPU_PASS_SHADOW_NEAR,
+    GPU_PASS_SHADOW_FAR,
+    GPU_PASS_GAME,
+    GPU_PASS_FIRST,
+    GPU_PASS_SECOND,
+
+    GPU_PASSES_AMOUNT
+}
+GpuPass;
+
+// Measure GPU time of render passes with GL_TIME_ELAPSED
+// queries. Every frame uses its own set of queries, results
+// are read a few frames later, and only if they're ready,
+// so the CPU never waits for the GPU. Passes can't be nested.
+// When GPU_TIMER_ENABLED is 0, all functions do nothing.
+//
+// gpu_timer_begin(GPU_PASS_GAME);
+//     ...
+// gpu_timer_end();
+void gpu_timer_init();
+
+// Call once per frame, before any pass is measured
+void gpu_timer_on_new_frame();
+
+void gpu_timer_begin(GpuPass pass);
+void gpu_timer_end();
+
+// Average pass times since the previous call are computed
+// and printed to stdout, then written to buf as a short
+// summary for the window title
+void gpu_timer_update_averages(char* buf, size_t buf_size);
+
+void gpu_timer_free();
+
+#endif
@@ -35,6 +35,7 @@ typedef struct                                                              \
 }                                                                           \
 HashMap_##TYPENAME;                                                         \
                                                                             \
+HashMap_##TYPENAME* hashmap_##TYPENAME ##_create(size_t array_size);        \
 void hashmap_##TYPENAME ##_insert(HashMap_##TYPENAME* map, TYPE elem);      \
 int  hashmap_##TYPENAME ##_remove(HashMap_##TYPENAME* map, TYPE elem);      \
 int  hashmap_##TYPENAME ##_contains(HashMap_##TYPENAME* map, TYPE elem);    \
@@ -12,129 +12,294 @@
 #include <texture.h>
 #include <db.h>
 #include <time_measure.h>
+#include <profiler.h>
+#include <gpu_timer.h>
+#include <depth_probe.h>
+#include <frame_arena.h>
 #include <player/player_controller.h>
 #include <camera/camera_controller.h>
 
 static float get_current_dof_depth(float dt)
 {
-    // glReadPixels is very slow :(
-    
     static float curr_depth = 1.0f;
+    static float desired_depth = 1.0f;
 
-    // Read depth in the center of the screen 
-    // and gradually move towards it
-    float desired_depth;
-    glReadPixels(g_window->width / 2, g_window->height / 2, 1, 1, 
-                 GL_DEPTH_COMPONENT, GL_FLOAT, &desired_depth);
+    // Read depth in the center of the screen and gradually
+    // move towards it. Value arrives a frame or two late,
+    // which is not noticeable due to smoothing anyway
+    depth_probe_read(g_window->width / 2, g_window->height / 2, &desired_depth);
     
     curr_depth = glm_lerp(curr_depth, desired_depth, dt * DOF_SPEED);
     return curr_depth;
 }
 
+static void save_profiler_trace()
+{
+    static int trace_num = 0;
+
+    char path[64];
+    sprintf(path, "profiler_trace_%d.json", trace_num++);
+    profiler_export(path);
+}
+
+static void on_keyboard_key(void* this_object, int glfw_keycode, int glfw_action_code)
+{
+    if (glfw_keycode == GLFW_KEY_F3 && glfw_action_code == GLFW_PRESS && PROFILER_ENABLED)
+        save_profiler_trace();
+}
+
+// Slow frame runs at most this many ticks, the rest of
+// time is dropped instead of making next frames slow too
+#define MAX_TICKS_PER_FRAME 5
+
+// Starting size of memory for per-frame data, grows if needed
+#define FRAME_ARENA_CAPACITY (256 * 1024)
+
+// Time not yet simulated and time since chunks were updated
+static double simulation_time_left = 0.0;
+static double map_update_time_left = 0.0;
+
+// Player moves in fixed ticks, so physics doesn't depend on frame
+// rate. Rendered position is interpolated between last two ticks
 static void update(PlayerController* pc, CameraController* cc, float dt)
 {
-    playercontroller_do_control(pc);
-    player_update(pc->player, dt);
+    Player* p = pc->player;
+    double const tick = 1.0 / SIMULATION_RATE;
+
+    playercontroller_update_view(pc);
+
+    simulation_time_left += dt;
+    int num_ticks = 0;
+    while (simulation_time_left >= tick && num_ticks < MAX_TICKS_PER_FRAME)
+    {
+        glm_vec3_copy(p->pos, p->prev_pos);
+        playercontroller_do_control(pc, tick);
+        simulation_time_left -= tick;
+        num_ticks++;
+    }
+    simulation_time_left = MIN(simulation_time_left, tick);
+
+    player_interpolate(p, (float)(simulation_time_left / tick));
+    player_update(p, dt);
     cameracontroller_do_control(cc);
+    map_start_culling(cc->camera);
+
+    double const map_interval = 1.0 / MAP_UPDATE_RATE;
+    map_update_time_left += dt;
+    if (map_update_time_left >= map_interval)
+    {
+        // Motion of the last tick, p->speed has no fly speed in it
+        vec3 velocity;
+        glm_vec3_sub(p->pos, p->prev_pos, velocity);
+        glm_vec3_scale(velocity, (float)SIMULATION_RATE, velocity);
+
+        map_update_chunks(cc->camera, velocity);
+        map_update_time_left = MIN(map_update_time_left - map_interval, map_interval);
+    }
     map_update(cc->camera);
 }
 
+// Light has to turn by more than this angle
+// (in radians) for shadow maps to be re-rendered
+#define SHADOW_LIGHT_THRESHOLD 0.002f
+
+// View distance is split between cascades with a mix of logarithmic
+// and uniform schemes, this is the share of logarithmic one
+#define SHADOW_SPLIT_LAMBDA 0.9f
+
+// Cascade covers a bit more than its part of view frustum, so with
+// shadow caching it can be kept while camera moves inside of margin
+#define SHADOW_COVER_MARGIN 0.15f
+
+// Cascade is fitted to a sphere around its part of view frustum, so
+// its size doesn't change when camera turns. Shadow map is kept from
+// previous frames until light turns, camera leaves the sphere or
+// chunk meshes inside of it change
+typedef struct
+{
+    vec3 center;
+    float radius;
+
+    mat4 mat;
+    vec4 planes[6];
+    vec3 light_dir;
+    int mesh_version;
+    int frames_since_render;
+    int is_valid;
+    int needs_render;
+}
+ShadowCascade;
+
 // Global for this file, ideally should be inside 
 // renderer file or be a part of renderer structure
-static mat4 near_shadowmap_mat;
-static mat4 far_shadowmap_mat;
+static ShadowCascade shadow_cascades[SHADOW_MAX_CASCADES];
 
-static float near_shadowmap_size;
-static float far_shadowmap_size;
+// Distance from camera where cascade starts, cascade
+// SHADOW_CASCADES ends where chunks are not rendered
+static float get_cascade_split(Camera* cam, int cascade)
+{
+    if (cascade == 0)
+        return cam->clip_near;
+
+    // Logarithmic scheme gives too small first cascade if
+    // started from near plane, so it starts a bit further
+    float const near = MAX(cam->clip_near, 10.0f * BLOCK_SIZE);
+    float const far  = CHUNK_RENDER_RADIUS * CHUNK_SIZE;
+    float const part = (float)cascade / SHADOW_CASCADES;
+
+    float const log_split     = near * powf(far / near, part);
+    float const uniform_split = near + (far - near) * part;
+    return glm_lerp(uniform_split, log_split, SHADOW_SPLIT_LAMBDA);
+}
 
-typedef enum
+// The smallest sphere around part of view frustum between near and far
+static float get_frustum_part_sphere(Camera* cam, float near, float far, vec3 center)
 {
-    NEARPLANE_DEFAULT,
-    NEARPLANE_EXTENDED
+    // Frustum corner at depth d is d * sqrt(k2) away from view axis
+    float const tan_half_fov = tanf(glm_rad(cam->fov) / 2.0f);
+    float const k2 = tan_half_fov * tan_half_fov * (1.0f + cam->aspect_ratio * cam->aspect_ratio);
+
+    // Center is equally far from near and far corners,
+    // unless far corners alone define the sphere
+    float dist = (near + far) / 2.0f * (1.0f + k2);
+    float radius;
+    if (dist >= far)
+    {
+        dist = far;
+        radius = far * sqrtf(k2);
+    }
+    else
+    {
+        radius = sqrtf((dist - near) * (dist - near) + near * near * k2);
+    }
+
+    vec3 offset;
+    glm_vec3_normalize_to(cam->front, offset);
+    glm_vec3_scale(offset, dist, offset);
+    glm_vec3_add(cam->pos, offset, center);
+    return radius;
 }
-NearPlaneType;
 
-static void gen_shadowmap_mat(mat4 res, Camera* cam, 
-                              float size_blocks, NearPlaneType near_choice)
+static void fit_shadow_cascade(ShadowCascade* sc, vec3 light_dir, vec3 center, float radius)
 {
-    vec3 light_dir;
-    map_get_light_dir(light_dir);
+    mat4 light_view_mat;
+    glm_look(GLM_VEC3_ZERO, light_dir, (vec3){ 0.0f, 1.0f, 0.0f }, light_view_mat);
 
-    vec3 light_pos;
-    glm_vec3_copy(cam->pos, light_pos);
+    // Cascade moves only by whole texels, so edges
+    // of shadows don't flicker when camera moves
+    float const texel_size = 2.0f * radius / g_window->fb->shadowmap_w;
+    vec3 light_space_center;
+    glm_mat4_mulv3(light_view_mat, center, 1.0f, light_space_center);
+    float const x = floorf(light_space_center[0] / texel_size) * texel_size;
+    float const y = floorf(light_space_center[1] / texel_size) * texel_size;
+    float const depth = -light_space_center[2];
 
-    // Minigate shadow edge flickering
-    float const discrete_step = BLOCK_SIZE / 2.0f;
-    for (int i = 0; i < 3; i++)
-        light_pos[i] = roundf(light_pos[i] / discrete_step) * discrete_step;
+    mat4 light_proj_mat;
+    glm_ortho(x - radius, x + radius, y - radius, y + radius, 
+              depth - radius, depth + radius, light_proj_mat);
+    glm_mat4_mul(light_proj_mat, light_view_mat, sc->mat);
+
+    // Planes include everything that casts shadows into cascade,
+    // casters in front of near plane are flattened by depth clamp
+    float const casters_dist = (CHUNK_RENDER_RADIUS + 3) * CHUNK_SIZE;
+    mat4 extended_mat;
+    glm_ortho(x - radius, x + radius, y - radius, y + radius, 
+              depth - radius - casters_dist, depth + radius, light_proj_mat);
+    glm_mat4_mul(light_proj_mat, light_view_mat, extended_mat);
+    glm_frustum_planes(extended_mat, sc->planes);
+
+    glm_vec3_copy(center, sc->center);
+    glm_vec3_copy(light_dir, sc->light_dir);
+    sc->radius = radius;
+}
 
-    mat4 light_view_mat;
-    glm_look(light_pos, light_dir, cam->up, light_view_mat);
+static int shadow_cascade_is_outdated(ShadowCascade* sc, vec3 light_dir)
+{
+    if (glm_vec3_dot(light_dir, sc->light_dir) < cosf(SHADOW_LIGHT_THRESHOLD))
+        return 1;
 
-    float ortho_right  =  size_blocks / 2.0f * BLOCK_SIZE;
-    float ortho_left   = -ortho_right;
-    float ortho_top    =  size_blocks / 2.0f * BLOCK_SIZE;
-    float ortho_bottom = -ortho_top;
-    float ortho_far    =  size_blocks / 2.0f * BLOCK_SIZE;
-    float ortho_near;
+    return map_meshes_changed_since(sc->mesh_version, sc->planes);
+}
 
-    switch (near_choice)
+static void update_shadow_cascade(ShadowCascade* sc, int cascade, Camera* cam, vec3 light_dir)
+{
+    vec3 center;
+    float radius = get_frustum_part_sphere(cam, get_cascade_split(cam, cascade), 
+                                           get_cascade_split(cam, cascade + 1), center);
+    if (SHADOW_CACHING)
+        radius *= 1.0f + SHADOW_COVER_MARGIN;
+
+    sc->frames_since_render++;
+    sc->needs_render = 0;
+
+    // Far cascades cover much more, so they are re-rendered less often.
+    // But if part of view frustum is not covered anymore, it can't wait
+    int const min_interval = (cascade == 0) ? 1 : SHADOW_FAR_INTERVAL;
+    if (SHADOW_CACHING && sc->is_valid && radius == sc->radius)
     {
-        case NEARPLANE_DEFAULT:    
-            ortho_near = -ortho_far; 
-            break;
-        case NEARPLANE_EXTENDED: 
-            ortho_near = -(CHUNK_RENDER_RADIUS + 3) * CHUNK_WIDTH * BLOCK_SIZE;
-            break;
+        float const max_offset = radius * SHADOW_COVER_MARGIN / (1.0f + SHADOW_COVER_MARGIN);
+        int const is_covered = glm_vec3_distance(center, sc->center) <= max_offset;
+
+        if (is_covered && (sc->frames_since_render < min_interval || 
+                           !shadow_cascade_is_outdated(sc, light_dir)))
+        {
+            return;
+        }
     }
 
-    mat4 light_proj_mat;
-    glm_ortho(ortho_left, ortho_right, ortho_bottom, ortho_top, 
-       ortho_near, ortho_far, light_proj_mat);
-
-    glm_mat4_mul(light_proj_mat, light_view_mat, res);
+    fit_shadow_cascade(sc, light_dir, center, radius);
+    sc->mesh_version = map_get_mesh_version();
+    sc->frames_since_render = 0;
+    sc->is_valid = 1;
+    sc->needs_render = 1;
 }
 
-static void gen_shadowmap_planes(vec4 res[6], Camera* cam, float size_blocks)
+static void update_all_shadow_cascades(Camera* cam)
 {
-    mat4 light_mat;
-    gen_shadowmap_mat(light_mat, cam, size_blocks, NEARPLANE_EXTENDED);
-    glm_frustum_planes(light_mat, res);
+    vec3 light_dir;
+    map_get_light_dir(light_dir);
+
+    for (int i = 0; i < SHADOW_CASCADES; i++)
+        update_shadow_cascade(&shadow_cascades[i], i, cam, light_dir);
 }
 
-static void render_shadowmap(mat4 light_mat, vec4 frustum_planes[6], int shadowmap_tex_width, 
-                             FbType fb_type, float polygon_offset)
+static void render_shadowmap(ShadowCascade* sc, int cascade)
 {
-    shader_use(shader_shadow);
-    shader_set_mat4(shader_shadow, "mvp_matrix", light_mat);
-    shader_set_texture_array(shader_shadow, "u_blocks_texture", texture_blocks, 0);
-
-    framebuffer_use(g_window->fb, fb_type);
+    framebuffer_use_shadowmap(g_window->fb, cascade);
 
     glClear(GL_DEPTH_BUFFER_BIT);
-    glViewport(0, 0, shadowmap_tex_width, shadowmap_tex_width);
+    glViewport(0, 0, g_window->fb->shadowmap_w, g_window->fb->shadowmap_w);
+
+    float const polygon_offset = (cascade == 0) ? 4.0f : 8.0f;
     glPolygonOffset(polygon_offset, polygon_offset);
 
-    map_render_chunks_raw(frustum_planes);
+    shader_use(shader_shadow_depth);
+    shader_set_int1(shader_shadow_depth, "u_cascade", cascade);
+    map_render_shadow_casters(sc->planes, 0);
+
+    shader_use(shader_shadow);
+    shader_set_int1(shader_shadow, "u_cascade", cascade);
+    shader_set_texture_array(shader_shadow, "u_blocks_texture", texture_blocks, 0);
+    map_render_shadow_casters(sc->planes, 1);
 }
 
-static void render_all_shadowmaps(Camera* cam)
+static void render_all_shadowmaps()
 {
-    near_shadowmap_size = 50.0f;
-    far_shadowmap_size  = (CHUNK_RENDER_RADIUS + 3) * CHUNK_WIDTH;
-    
-    gen_shadowmap_mat(near_shadowmap_mat, cam, near_shadowmap_size, NEARPLANE_DEFAULT);
-    gen_shadowmap_mat(far_shadowmap_mat,  cam, far_shadowmap_size,  NEARPLANE_DEFAULT);
-
-    vec4 near_planes[6], far_planes[6];
-    gen_shadowmap_planes(near_planes, cam, near_shadowmap_size);
-    gen_shadowmap_planes(far_planes,  cam, far_shadowmap_size);
-    
     glEnable(GL_DEPTH_CLAMP);
     glEnable(GL_POLYGON_OFFSET_FILL);
 
-    render_shadowmap(near_shadowmap_mat, near_planes, g_window->fb->near_shadowmap_w, FBTYPE_SHADOW_NEAR, 4.0f);
-    render_shadowmap(far_shadowmap_mat,  far_planes,  g_window->fb->far_shadowmap_w,  FBTYPE_SHADOW_FAR,  8.0f);
+    // All cascades after the first one are measured as far pass
+    for (int i = 0; i < SHADOW_CASCADES; i++)
+    {
+        if (i <= 1)
+            gpu_timer_begin(i == 0 ? GPU_PASS_SHADOW_NEAR : GPU_PASS_SHADOW_FAR);
+
+        if (shadow_cascades[i].needs_render)
+            render_shadowmap(&shadow_cascades[i], i);
+
+        if (i == 0 || i == SHADOW_CASCADES - 1)
+            gpu_timer_end();
+    }
 
     glDisable(GL_POLYGON_OFFSET_FILL);
     glDisable(GL_DEPTH_CLAMP);
@@ -151,7 +316,7 @@ static void render_game(Player* p, Camera* cam)
     {
         map_render_sky(cam);
         map_render_sun_moon(cam);
-        map_render_chunks(cam, near_shadowmap_mat, far_shadowmap_mat);
+        map_render_chunks(cam);
     }
 
     framebuffer_use_texture(TEX_UI);
@@ -193,7 +358,7 @@ static void render_first_pass(float dt)
 }
 
 // Apply motion blur, gamma correction, saturation and render to screen
-static void render_second_pass(Player* p, Camera* cam, float dt)
+static void render_second_pass()
 {
     shader_use(shader_deferred2);
 
@@ -207,25 +372,8 @@ static void render_second_pass(Player* p, Camera* cam, float dt)
     shader_set_int1(shader_deferred2, "u_motion_blur_enabled", MOTION_BLUR_ENABLED);
     if (MOTION_BLUR_ENABLED)
     {
-        mat4 matrix;
-        glm_mat4_inv(cam->proj_matrix, matrix);
-        shader_set_mat4(shader_deferred2, "u_projection_inv_matrix", matrix);
-
-        glm_mat4_inv(cam->view_matrix, matrix);
-        shader_set_mat4(shader_deferred2, "u_view_inv_matrix", matrix);
-
-        glm_mat4_copy(cam->prev_view_matrix, matrix);
-        shader_set_mat4(shader_deferred2, "u_prev_view_matrix", matrix);
-
-        glm_mat4_copy(cam->proj_matrix, matrix);
-        shader_set_mat4(shader_deferred2, "u_projection_matrix", matrix);
-
-        shader_set_float3(shader_deferred2, "u_cam_pos", cam->pos);
-        shader_set_float3(shader_deferred2, "u_prev_cam_pos", cam->prev_pos);
-
         shader_set_float1(shader_deferred2, "u_strength", MOTION_BLUR_STRENGTH);
         shader_set_int1(shader_deferred2, "u_samples", MOTION_BLUR_SAMPLES);
-        shader_set_float1(shader_deferred2, "u_dt", dt);
     }
 
     shader_set_float1(shader_deferred2, "u_gamma", GAMMA);
@@ -242,23 +390,64 @@ static void render_second_pass(Player* p, Camera* cam, float dt)
 static void render_debug_shadowmaps()
 {
     shader_use(shader_pip);
-    shader_set_texture_2d(shader_pip, "u_texture", g_window->fb->gbuf_shadow_near_map, 0);
-    int w = 325;
-    int h = 325;
-    glViewport(10, g_window->height - h - 10, w, h);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    shader_set_texture_array(shader_pip, "u_texture", g_window->fb->gbuf_shadow_maps, 0);
+    int w = 250;
+    int h = 250;
+    for (int i = 0; i < SHADOW_CASCADES; i++)
+    {
+        shader_set_int1(shader_pip, "u_layer", i);
+        glViewport(10 + i * (w + 10), g_window->height - h - 10, w, h);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+}
 
-    shader_set_texture_2d(shader_pip, "u_texture", g_window->fb->gbuf_shadow_far_map, 0);
-    glViewport(g_window->width - w - 10, g_window->height - h - 10, w, h);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+// Fill uniform buffer shared by all shaders
+static void update_frame_data(Camera* cam, float dt)
+{
+    FrameData data;
+
+    glm_mat4_copy(cam->vp_matrix, data.vp_matrix);
+    glm_mat4_copy(cam->proj_matrix, data.proj_matrix);
+    glm_mat4_inv(cam->proj_matrix, data.proj_inv_matrix);
+    glm_mat4_inv(cam->view_matrix, data.view_inv_matrix);
+    glm_mat4_copy(cam->prev_view_matrix, data.prev_view_matrix);
+    for (int i = 0; i < SHADOW_MAX_CASCADES; i++)
+        glm_mat4_copy(shadow_cascades[i].mat, data.shadowmap_mats[i]);
+
+    glm_vec3_copy(cam->pos, data.cam_pos);
+    glm_vec3_copy(cam->prev_pos, data.prev_cam_pos);
+    data.dt = dt;
+
+    map_fill_frame_data(&data);
+    shader_update_frame_data(&data);
 }
 
 static void render(Player* p, Camera* cam, float dt)
 { 
-    render_all_shadowmaps(cam);
+    update_all_shadow_cascades(cam);
+    update_frame_data(cam, dt);
+
+    PROFILER_ZONE_BEGIN("render_all_shadowmaps");
+    render_all_shadowmaps();
+    PROFILER_ZONE_END();
+
+    PROFILER_ZONE_BEGIN("render_game");
+    gpu_timer_begin(GPU_PASS_GAME);
     render_game(p, cam);
+    gpu_timer_end();
+    PROFILER_ZONE_END();
+
+    PROFILER_ZONE_BEGIN("render_first_pass");
+    gpu_timer_begin(GPU_PASS_FIRST);
     render_first_pass(dt);
-    render_second_pass(p, cam, dt);
+    gpu_timer_end();
+    PROFILER_ZONE_END();
+
+    PROFILER_ZONE_BEGIN("render_second_pass");
+    gpu_timer_begin(GPU_PASS_SECOND);
+    render_second_pass();
+    gpu_timer_end();
+    PROFILER_ZONE_END();
 
 #ifdef DEBUG
     render_debug_shadowmaps();
@@ -278,6 +467,12 @@ int main(int argc, const char** argv)
         fprintf(stdout, "No arg was provided. Using default config path: %s\n", config_path);
     }
     config_load(config_path);
+
+    if (PROFILER_ENABLED)
+    {
+        profiler_init();
+        profiler_set_thread_name("main");
+    }
     
     window_init();
     
@@ -327,6 +522,8 @@ int main(int argc, const char** argv)
     shaders_init();
     textures_init();
     map_init();
+    gpu_timer_init();
+    depth_probe_init();
     ui_init((float)WINDOW_WIDTH / WINDOW_HEIGHT);
 
     Player* player = player_create();
@@ -346,37 +543,58 @@ int main(int argc, const char** argv)
     {
         .front = player->front,
         .up = player->up,
-        .pos = player->pos,
+        .pos = player->render_pos,
         .pitch = &player->pitch,
         .yaw = &player->yaw
     };
     cameracontroller_set_track_object(cc, &info);
 
+    register_keyboard_key_press_callback(NULL, on_keyboard_key);
+
+    frame_arena_init(FRAME_ARENA_CAPACITY);
     while (!glfwWindowShouldClose(g_window->glfw))
     {
+        PROFILER_ZONE_BEGIN("frame");
+        frame_arena_reset();
+        gpu_timer_on_new_frame();
         window_update_title_fps();
 
         dt_on_new_frame();
         float dt = dt_get();
 
+        PROFILER_ZONE_BEGIN("update");
         update(pc, cc, dt);
+        PROFILER_ZONE_END();
+
         render(player, cam, dt);
         // printf("%.2f %.2f %.2f\n", player->cam->object_pos[0], player->cam->object_pos[1], player->cam->object_pos[2]);
 
+        PROFILER_ZONE_BEGIN("swap_buffers");
         glfwSwapBuffers(g_window->glfw);
-        window_poll_events();
+        PROFILER_ZONE_END();
 
+        window_poll_events();
+        PROFILER_ZONE_END();
     }
 
     player_destroy(player);
 
     ui_free();
+    gpu_timer_free();
+    depth_probe_free();
     map_free();
+    frame_arena_free();
     textures_free();
     shaders_free();
     db_free();
 
     window_free();
 
+    if (PROFILER_ENABLED)
+    {
+        save_profiler_trace();
+        profiler_free();
+    }
+
     return 0;
 }
\ No newline at end of file
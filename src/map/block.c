@@ -38,11 +38,59 @@ unsigned char block_textures[][6] =
     {182, 182, 181, 183, 182, 182},      // 32  BLOCK_CACTUS      
     { 48,  48,  64,  32,  48,  48},      // 33  BLOCK_SANDSTONE      
     { 21,  21,  64,  32,  21,  21},      // 34  BLOCK_SANDSTONE_CHISELED      
+    {153, 153, 153, 153, 153, 153},      // 35  BLOCK_GLOWSTONE
 };
 
+#define S BLOCK_PROP_SOLID
+#define T BLOCK_PROP_TRANSPARENT
+#define P BLOCK_PROP_PLANT
+const BlockProperties block_properties[BLOCKS_AMOUNT] =
+{
+    // flags     light
+    { T,          0 },    // 0   BLOCK_AIR
+    { S,          0 },    // 1   BLOCK_PLAYER_HAND
+    { S,          0 },    // 2   BLOCK_STONE
+    { S,          0 },    // 3   BLOCK_DIRT
+    { S,          0 },    // 4   BLOCK_GRASS
+    { S,          0 },    // 5   BLOCK_WOODEN_PLANKS
+    { S,          0 },    // 6   BLOCK_POLISHED_STONE
+    { S,          0 },    // 7   BLOCK_BRICKS
+    { S,          0 },    // 8   BLOCK_COBBLESTONE
+    { S,          0 },    // 9   BLOCK_BEDROCK
+    { S,          0 },    // 10  BLOCK_SAND
+    { S,          0 },    // 11  BLOCK_GRAVEL
+    { S,          0 },    // 12  BLOCK_WOOD
+    { S,          0 },    // 13  BLOCK_IRON
+    { S,          0 },    // 14  BLOCK_GOLD
+    { S,          0 },    // 15  BLOCK_DIAMOND
+    { S,          0 },    // 16  BLOCK_EMERALD
+    { S,          0 },    // 17  BLOCK_REDSTONE
+    { S,          0 },    // 18  BLOCK_MOSSY_COBBLESTONE
+    { S,          0 },    // 19  BLOCK_OBSIDIAN
+    { S,          0 },    // 20  BLOCK_STONE_BRICKS
+    { S,          0 },    // 21  BLOCK_SNOW
+    { S,          0 },    // 22  BLOCK_SNOW_GRASS
+    { S | T,      0 },    // 23  BLOCK_GLASS
+    { T,          0 },    // 24  BLOCK_WATER
+    { S | T,      0 },    // 25  BLOCK_LEAVES
+    { S | T | P,  0 },    // 26  BLOCK_GRASS_PLANT
+    { S | T | P,  0 },    // 27  BLOCK_FLOWER_ROSE
+    { S | T | P,  0 },    // 28  BLOCK_FLOWER_DANDELION
+    { S | T | P,  0 },    // 29  BLOCK_MUSHROOM_BROWN
+    { S | T | P,  0 },    // 30  BLOCK_MUSHROOM_RED
+    { S | T | P,  0 },    // 31  BLOCK_DEAD_PLANT
+    { S | T,      0 },    // 32  BLOCK_CACTUS
+    { S,          0 },    // 33  BLOCK_SANDSTONE
+    { S,          0 },    // 34  BLOCK_SANDSTONE_CHISELED
+    { S,         15 },    // 35  BLOCK_GLOWSTONE
+};
+#undef S
+#undef T
+#undef P
+
 void gen_cube_vertices(Vertex* vertices, int* curr_vertex_count, int x, int y, int z,
                        int block_type, float block_size, int is_short, int faces[6],
-                       float ao[6][4])
+                       float ao[6][4], unsigned char light[6])
 {
     // 6 faces, each face has 4 points forming a square
     static const float pos[6][4][3] =
@@ -135,12 +183,13 @@ void gen_cube_vertices(Vertex* vertices, int* curr_vertex_count, int x, int y, i
             vertices[i].ao           = ao[f][index];
             vertices[i].tile         = block_textures[block_type][f];
             vertices[i].normal       = f;
+            vertices[i].light        = light[f];
         }
     }
 }
 
 void gen_plant_vertices(Vertex* vertices, int* curr_vertex_count, int x, int y, int z,
-                        int block_type, float block_size)
+                        int block_type, float block_size, unsigned char light)
 {
     // A cross made up of 2 perpendicular quads
     static const float pos[2][4][3] =
@@ -179,6 +228,7 @@ void gen_plant_vertices(Vertex* vertices, int* curr_vertex_count, int x, int y,
         vertices[i].ao           = 0.0f;
         vertices[i].tile         = block_textures[block_type][f];
         vertices[i].normal       = normals[f];
+        vertices[i].light        = light;
     }
 }
 
@@ -192,55 +242,6 @@ void block_gen_aabb(int x, int y, int z, vec3 aabb[2])
     aabb[1][2] = aabb[0][2] + BLOCK_SIZE;
 }
 
-int block_is_solid(unsigned char block)
-{
-    switch (block)
-    {
-        case BLOCK_AIR:
-        case BLOCK_WATER:
-            return 0;
-        default:
-            return 1;
-    }
-}
-
-int block_is_transparent(unsigned char block)
-{
-    switch (block)
-    {
-        case BLOCK_AIR:
-        case BLOCK_GLASS:
-        case BLOCK_WATER:
-        case BLOCK_LEAVES:
-        case BLOCK_GRASS_PLANT:
-        case BLOCK_FLOWER_ROSE:
-        case BLOCK_FLOWER_DANDELION:
-        case BLOCK_MUSHROOM_BROWN:
-        case BLOCK_MUSHROOM_RED:
-        case BLOCK_DEAD_PLANT:
-        case BLOCK_CACTUS:
-            return 1;
-        default:
-            return 0;
-    }
-}
-
-int block_is_plant(unsigned char block)
-{
-    switch (block)
-    {
-        case BLOCK_GRASS_PLANT:
-        case BLOCK_FLOWER_ROSE:
-        case BLOCK_FLOWER_DANDELION:
-        case BLOCK_MUSHROOM_BROWN:
-        case BLOCK_MUSHROOM_RED:
-        case BLOCK_DEAD_PLANT:
-            return 1;
-        default:
-            return 0;
-    }
-}
-
 // ray - aabb hit detection, see
 // https://medium.com/@bromanz/another-view-on-the-classic-ray-aabb-intersection-algorithm-for-bvh-traversal-41125138b525
 int block_ray_intersection(vec3 ray_pos, vec3 ray_dir, int bx, int by, int bz, unsigned char b_type)
@@ -39,7 +39,8 @@
 #define BLOCK_CACTUS             32
 #define BLOCK_SANDSTONE          33
 #define BLOCK_SANDSTONE_CHISELED 34
-#define BLOCKS_AMOUNT            35
+#define BLOCK_GLOWSTONE          35
+#define BLOCKS_AMOUNT            36
 
 // Faces order
 #define BLOCK_FACE_LFT           0
@@ -49,21 +50,58 @@
 #define BLOCK_FACE_BCK           4
 #define BLOCK_FACE_FRT           5
 
+// Property flags of block
+#define BLOCK_PROP_SOLID         (1 << 0)
+#define BLOCK_PROP_TRANSPARENT   (1 << 1)
+#define BLOCK_PROP_PLANT         (1 << 2)
+
+// Everything known about block type besides textures,
+// new per-block data goes here instead of switches
+typedef struct
+{
+    unsigned char flags;
+
+    // Level of light that block emits, 0 to 15
+    unsigned char light;
+}
+BlockProperties;
+
 // Textures for each face of each block
 extern unsigned char block_textures[][6];
 
+// Properties of each block, indexed by block id
+extern const BlockProperties block_properties[BLOCKS_AMOUNT];
+
+// Light of each face is light of block that it faces, see Vertex
 void gen_cube_vertices(Vertex* vertices, int* curr_vertex_count, int x, int y, int z,
                        int block_type, float block_size, int is_short, int faces[6],
-                       float ao[6][4]);
+                       float ao[6][4], unsigned char light[6]);
 
 void gen_plant_vertices(Vertex* vertices, int* curr_vertex_count, int x, int y, int z,
-                        int block_type, float block_size);
+                        int block_type, float block_size, unsigned char light);
+
+// Player and mobs collide with solid blocks
+static inline int block_is_solid(unsigned char block)
+{
+    return block_properties[block].flags & BLOCK_PROP_SOLID;
+}
 
-int block_is_solid(unsigned char block);
+// Faces of neighbours are visible through transparent blocks
+static inline int block_is_transparent(unsigned char block)
+{
+    return block_properties[block].flags & BLOCK_PROP_TRANSPARENT;
+}
 
-int block_is_transparent(unsigned char block);
+// Plants are meshed as a cross of 2 quads instead of cube
+static inline int block_is_plant(unsigned char block)
+{
+    return block_properties[block].flags & BLOCK_PROP_PLANT;
+}
 
-int block_is_plant(unsigned char block);
+static inline int block_get_light(unsigned char block)
+{
+    return block_properties[block].light;
+}
 
 void block_gen_aabb(int x, int y, int z, vec3 aabb[2]);
 
@@ -0,0 +1,141 @@
+#include <map/cave_culler.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <map/block.h>
+#include <utils.h>
+
+// Offsets of neighbour slice for each BLOCK_FACE_*,
+// opposite face is always face ^ 1
+static const int face_offsets[6][3] =
+{
+    { -1,  0,  0 }, // left
+    {  1,  0,  0 }, // right
+    {  0,  1,  0 }, // top
+    {  0, -1,  0 }, // bottom
+    {  0,  0, -1 }, // back
+    {  0,  0,  1 }, // front
+};
+
+static int slice_is_visible(int cx, int slice, int cz, vec4 planes[6])
+{
+    vec3 aabb[2];
+    aabb[0][0] = cx * CHUNK_SIZE;
+    aabb[0][1] = slice * CHUNK_SLICE_HEIGHT * BLOCK_SIZE;
+    aabb[0][2] = cz * CHUNK_SIZE;
+    aabb[1][0] = aabb[0][0] + CHUNK_SIZE;
+    aabb[1][1] = aabb[0][1] + CHUNK_SLICE_HEIGHT * BLOCK_SIZE;
+    aabb[1][2] = aabb[0][2] + CHUNK_SIZE;
+
+    return glm_aabb_frustum(aabb, planes);
+}
+
+CaveCuller* cave_culler_create()
+{
+    CaveCuller* cc = malloc(sizeof(CaveCuller));
+
+    cc->grid = NULL;
+    cc->visited = NULL;
+    cc->queue = NULL;
+    cc->capacity = 0;
+    cc->num_visited = 0;
+
+    return cc;
+}
+
+int cave_culler_run(CaveCuller* cc, vec3 cam_pos, vec4 planes[6], 
+                    int radius, CaveCullerGetChunk get_chunk)
+{
+    int const num_slices = chunk_get_num_slices();
+    if (num_slices > CHUNK_MAX_SLICES)
+        return 0;
+
+    int const cam_cx = (int)floorf(cam_pos[0] / CHUNK_SIZE);
+    int const cam_cz = (int)floorf(cam_pos[2] / CHUNK_SIZE);
+    int const cam_by = (int)floorf(cam_pos[1] / BLOCK_SIZE);
+    int const cam_slice = MAX(0, MIN(num_slices - 1, cam_by / CHUNK_SLICE_HEIGHT));
+
+    if (!get_chunk(cam_cx, cam_cz))
+        return 0;
+
+    int const side = 2 * radius + 1;
+    int const num_nodes = side * side * num_slices;
+    if (num_nodes > cc->capacity)
+    {
+        cc->capacity = num_nodes;
+        cc->grid = realloc(cc->grid, side * side * sizeof(Chunk*));
+        cc->visited = realloc(cc->visited, num_nodes);
+        cc->queue = realloc(cc->queue, num_nodes * sizeof(CaveCullerNode));
+    }
+
+    // Node is ((gx * side) + gz) * num_slices + slice
+    for (int gx = 0; gx < side; gx++)
+    for (int gz = 0; gz < side; gz++)
+    {
+        Chunk* c = get_chunk(cam_cx + gx - radius, cam_cz + gz - radius);
+        cc->grid[gx * side + gz] = c;
+        if (c)
+            c->is_cave_visible = 0;
+    }
+    memset(cc->visited, 0, num_nodes);
+
+    int head = 0, tail = 0;
+    int const start = ((radius * side) + radius) * num_slices + cam_slice;
+    cc->queue[tail++] = (CaveCullerNode){ start, -1, 0 };
+    cc->visited[start] = 1;
+
+    while (head < tail)
+    {
+        CaveCullerNode const curr = cc->queue[head++];
+        int const slice = curr.node % num_slices;
+        int const gz = curr.node / num_slices % side;
+        int const gx = curr.node / num_slices / side;
+
+        Chunk* c = cc->grid[gx * side + gz];
+        c->is_cave_visible = 1;
+
+        for (int f = 0; f < 6; f++)
+        {
+            // Going back can't reveal anything new
+            if (curr.directions & (1 << (f ^ 1)))
+                continue;
+
+            if (curr.entered_face >= 0 && 
+                !(c->slice_connections[slice][curr.entered_face] & (1 << f)))
+            {
+                continue;
+            }
+
+            int const nx = gx + face_offsets[f][0];
+            int const ns = slice + face_offsets[f][1];
+            int const nz = gz + face_offsets[f][2];
+            if (nx < 0 || nx >= side || nz < 0 || nz >= side || ns < 0 || ns >= num_slices)
+                continue;
+
+            int const next = ((nx * side) + nz) * num_slices + ns;
+            if (cc->visited[next] || !cc->grid[nx * side + nz])
+                continue;
+
+            int const cx = cam_cx + nx - radius;
+            int const cz = cam_cz + nz - radius;
+            if (!slice_is_visible(cx, ns, cz, planes))
+                continue;
+
+            cc->visited[next] = 1;
+            cc->queue[tail++] = (CaveCullerNode){ next, f ^ 1, curr.directions | (1 << f) };
+        }
+    }
+
+    cc->num_visited = tail;
+    return 1;
+}
+
+void cave_culler_destroy(CaveCuller* cc)
+{
+    free(cc->grid);
+    free(cc->visited);
+    free(cc->queue);
+    free(cc);
+}
@@ -0,0 +1,51 @@
+#ifndef CAVE_CULLER_H_
+#define CAVE_CULLER_H_
+
+#include <cglm/cglm.h>
+
+#include <map/chunk.h>
+
+// Visibility search through chunk slices ("advanced cave culling").
+// It starts at the slice with camera and enters neighbour slice
+// only if the face it came through is connected to the face it
+// leaves through. It never goes in direction opposite to one it
+// already went, so slices behind ground and walls are not reached.
+//
+// cave_culler_run(cc, pos, planes, radius, get_chunk);
+// if (c->is_cave_visible) ...
+
+// Returns NULL if chunk is not loaded
+typedef Chunk* (*CaveCullerGetChunk)(int cx, int cz);
+
+typedef struct
+{
+    int node;
+    signed char entered_face;
+    unsigned char directions;
+}
+CaveCullerNode;
+
+typedef struct
+{
+    // Loaded chunks in square around camera
+    Chunk** grid;
+    unsigned char* visited;
+    CaveCullerNode* queue;
+    int capacity;
+
+    // Slices reached by last search
+    int num_visited;
+}
+CaveCuller;
+
+CaveCuller* cave_culler_create();
+
+// Sets is_cave_visible of every chunk in square of given radius
+// around camera. Returns 0 without changing anything if camera
+// is not in loaded chunk or chunks are too high to be split
+int cave_culler_run(CaveCuller* cc, vec3 cam_pos, vec4 planes[6], 
+                    int radius, CaveCullerGetChunk get_chunk);
+
+void cave_culler_destroy(CaveCuller* cc);
+
+#endif
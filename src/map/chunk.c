@@ -1,66 +1,99 @@
 #include <map/chunk.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <map/block.h>
+#include <map/chunk_pool.h>
+#include <map/light.h>
 #include <utils.h>
 #include <db.h>
 #include <worldgen.h>
+#include <profiler.h>
 
 Chunk* chunk_init(int cx, int cz)
 {
-    Chunk* c = malloc(sizeof(Chunk));
+    // GPU objects and light edits array of previous
+    // chunk in the same slot are reused
+    Chunk* c = chunk_pool_acquire();
 
     c->blocks = NULL;
     c->x = cx;
     c->z = cz;
 
+    c->light = NULL;
+    c->num_light_edits = 0;
+    c->num_readers = 0;
+
+    c->state = CHUNK_REQUESTED;
     c->is_dirty = 0;
-    c->is_generated = 0;
-    c->is_safe_to_modify = 1;
+    c->has_mesh = 0;
+    c->out_of_range_ns = 0;
+
+    c->lod = 0;
+    c->mesh_lod = 0;
 
-    c->VAO_land = 0;
-    c->VBO_land = 0;
-    c->VAO_water = 0;
-    c->VBO_water = 0;
     c->vertex_land_count = 0;
     c->vertex_water_count = 0;
 
+    c->water_arena = NULL;
+    c->water_arena_first = 0;
+    c->water_arena_count = 0;
+
+    c->vertex_shadow_count = 0;
+    c->vertex_shadow_alpha_count = 0;
+
+    c->min_y = 0;
+    c->max_y = CHUNK_HEIGHT - 1;
+    c->opaque_slices = 0;
+    c->is_occluded = 0;
+    c->is_cave_visible = 1;
+
+    // Not meshed chunks don't block visibility
+    memset(c->slice_connections, CHUNK_SLICE_ALL_FACES, sizeof(c->slice_connections));
+
+    c->occlusion_query_frame = -1;
+
     c->generated_mesh_terrain = NULL;
     c->generated_mesh_water = NULL;
+    c->generated_mesh_shadow = NULL;
+    c->generated_mesh_shadow_alpha = NULL;
+    c->generated_min_y = 0;
+    c->generated_max_y = CHUNK_HEIGHT - 1;
+    c->generated_opaque_slices = 0;
+    memset(c->generated_slice_connections, CHUNK_SLICE_ALL_FACES, 
+           sizeof(c->generated_slice_connections));
 
     return c;
 }
 
 void chunk_generate_terrain(Chunk* c)
 {
-    c->blocks = calloc(CHUNK_WIDTH_REAL * CHUNK_WIDTH_REAL * CHUNK_HEIGHT_REAL, 1);
+    c->blocks = chunk_pool_acquire_buffer();
+    memset(c->blocks, 0, CHUNK_WIDTH_REAL * CHUNK_WIDTH_REAL * CHUNK_HEIGHT_REAL);
+
+    PROFILER_ZONE_BEGIN("worldgen_generate_chunk");
     worldgen_generate_chunk(c);
+    PROFILER_ZONE_END();
+
+    PROFILER_ZONE_BEGIN("db_get_blocks_for_chunk");
     db_get_blocks_for_chunk(c);
-}
+    PROFILER_ZONE_END();
 
-/*
-Neighs array layout (view towards -Y):
+    PROFILER_ZONE_BEGIN("light_compute");
+    c->light = chunk_pool_acquire_buffer();
+    light_compute(c);
+    PROFILER_ZONE_END();
+}
 
-----> +X   Top layer   Middle layer   Bottom layer
-|          18 21 24    9  12 15       0 3 6
-v          19 22 25    10 13 16       1 4 7
-+Z         20 23 26    11 14 17       2 5 8
-*/
-static void block_get_neighs(Chunk* c, int x, int y, int z, unsigned char b_neighs[27])
+void chunk_add_light_edit(Chunk* c, int index)
 {
-    int index = 0;
-
-    for (int dy = -1; dy <= 1; dy++)
-    for (int dx = -1; dx <= 1; dx++)
-    for (int dz = -1; dz <= 1; dz++, index++)
+    if (c->num_light_edits == c->light_edits_capacity)
     {
-        int const bx = x + dx;
-        int const by = y + dy;
-        int const bz = z + dz;
-
-        b_neighs[index] = c->blocks[XYZ(bx, by, bz)];
+        c->light_edits_capacity = c->light_edits_capacity ? c->light_edits_capacity * 2 : 16;
+        c->light_edits = realloc(c->light_edits, c->light_edits_capacity * sizeof(int));
     }
+    c->light_edits[c->num_light_edits++] = index;
 }
 
 static int should_be_visible(unsigned char block, Chunk* c, 
@@ -87,7 +120,191 @@ static int block_set_visible_faces(Chunk* c, int x, int y, int z, int faces[6])
     return num_visible;
 }
 
-static void block_set_ao(unsigned char neighs[27], float ao[6][4])
+// Opacity of blocks is kept as bitmasks of columns, so visible faces
+// and ambient occlusion don't need random reads of blocks. Bit y + 1
+// of column is block at height y, bits 0 and CHUNK_HEIGHT + 1 are
+// halo blocks. Columns include halo columns of neighbours too
+typedef struct
+{
+    int words;
+    uint64_t* opaque;
+
+    // Opaque blocks with visible faces and all non-air transparent
+    // blocks, only for columns inside of chunk
+    uint64_t* candidates;
+
+    // Candidates of all columns with the same x combined
+    uint64_t* layers;
+}
+ChunkColumns;
+
+// 64-bit words in one column of blocks with halo
+static inline int get_column_words()
+{
+    return (CHUNK_HEIGHT_REAL + 63) / 64;
+}
+
+#define COLUMN_OPAQUE(cols, x, z) \
+    (&(cols)->opaque[(((x) + 1) * CHUNK_WIDTH_REAL + (z) + 1) * (cols)->words])
+
+static inline int column_get(const uint64_t* column, int y)
+{
+    int const bit = y + 1;
+    return (column[bit >> 6] >> (bit & 63)) & 1;
+}
+
+// Bits of column shifted by one block, so bit y + 1 is block above / below
+static inline uint64_t column_word_above(const uint64_t* column, int i, int words)
+{
+    uint64_t const next = (i + 1 < words) ? column[i + 1] : 0;
+    return (column[i] >> 1) | (next << 63);
+}
+
+static inline uint64_t column_word_below(const uint64_t* column, int i)
+{
+    uint64_t const prev = (i > 0) ? column[i - 1] : 0;
+    return (column[i] << 1) | (prev >> 63);
+}
+
+// Blocks are read once in memory order, opaque blocks
+// of chunk itself are counted for every slice too
+static void chunk_columns_build(Chunk* c, ChunkMeshBuffers* buffers, ChunkColumns* cols, 
+                                int* opaque_in_slice, int num_slices)
+{
+    int const words = get_column_words();
+    cols->words = words;
+    cols->opaque = buffers->columns_opaque;
+    cols->candidates = buffers->columns_candidates;
+    cols->layers = buffers->columns_layers;
+    uint64_t* transparent = buffers->columns_transparent;
+    memset(cols->opaque, 0, CHUNK_WIDTH_REAL * CHUNK_WIDTH_REAL * words * sizeof(uint64_t));
+    memset(cols->layers, 0, CHUNK_WIDTH * words * sizeof(uint64_t));
+    memset(transparent, 0, CHUNK_WIDTH * CHUNK_WIDTH * words * sizeof(uint64_t));
+
+    for (int x = -1; x <= CHUNK_WIDTH; x++)
+    for (int y = -1; y <= CHUNK_HEIGHT; y++)
+    {
+        int const bit = y + 1;
+        int const word = bit >> 6;
+        int const shift = bit & 63;
+        unsigned char* row = &c->blocks[XYZ(x, y, -1)];
+        uint64_t* column = &cols->opaque[(x + 1) * CHUNK_WIDTH_REAL * words + word];
+
+        // Most of rows above terrain are only air, which is 0
+        unsigned char any_block = 0;
+        for (int z = 0; z < CHUNK_WIDTH_REAL; z++)
+            any_block |= row[z];
+        if (any_block == 0)
+            continue;
+
+        int num_opaque = 0;
+        for (int z = 0; z < CHUNK_WIDTH_REAL; z++)
+        {
+            uint64_t const is_opaque = !block_is_transparent(row[z]);
+            column[z * words] |= is_opaque << shift;
+            num_opaque += (int)is_opaque;
+        }
+
+        // Halo blocks are needed only for opacity
+        if (x < 0 || x >= CHUNK_WIDTH || y < 0 || y >= CHUNK_HEIGHT)
+            continue;
+
+        num_opaque -= !block_is_transparent(row[0]) + !block_is_transparent(row[CHUNK_WIDTH + 1]);
+        if (y / CHUNK_SLICE_HEIGHT < num_slices)
+            opaque_in_slice[y / CHUNK_SLICE_HEIGHT] += num_opaque;
+
+        uint64_t* transparent_column = &transparent[x * CHUNK_WIDTH * words + word];
+        for (int z = 0; z < CHUNK_WIDTH; z++)
+        {
+            unsigned char const block = row[z + 1];
+            uint64_t const is_transparent_nonair = block_is_transparent(block) && block != BLOCK_AIR;
+            transparent_column[z * words] |= is_transparent_nonair << shift;
+        }
+    }
+
+    // Halo blocks above and below are never meshed
+    uint64_t* inside = buffers->columns_inside;
+    for (int i = 0; i < words; i++)
+    {
+        int const first = MAX(i * 64, 1);
+        int const last = MIN(i * 64 + 63, CHUNK_HEIGHT);
+        uint64_t const hi = (last - i * 64 == 63) ? ~0ull : (2ull << (last - i * 64)) - 1;
+        uint64_t const lo = ~((1ull << (first - i * 64)) - 1);
+        inside[i] = (first <= last) ? hi & lo : 0;
+    }
+
+    // Opaque block has visible face if any neighbour is not opaque
+    for (int x = 0; x < CHUNK_WIDTH; x++)
+    for (int z = 0; z < CHUNK_WIDTH; z++)
+    {
+        uint64_t const* self  = COLUMN_OPAQUE(cols, x,     z);
+        uint64_t const* left  = COLUMN_OPAQUE(cols, x - 1, z);
+        uint64_t const* right = COLUMN_OPAQUE(cols, x + 1, z);
+        uint64_t const* back  = COLUMN_OPAQUE(cols, x,     z - 1);
+        uint64_t const* front = COLUMN_OPAQUE(cols, x,     z + 1);
+
+        int const index = (x * CHUNK_WIDTH + z) * words;
+        for (int i = 0; i < words; i++)
+        {
+            uint64_t const covered = left[i] & right[i] & back[i] & front[i]
+                                   & column_word_above(self, i, words)
+                                   & column_word_below(self, i);
+            uint64_t const candidates = ((self[i] & ~covered) | transparent[index + i]) & inside[i];
+            cols->candidates[index + i] = candidates;
+            cols->layers[x * words + i] |= candidates;
+        }
+    }
+}
+
+// Same as block_set_visible_faces() for opaque block
+static int opaque_block_set_visible_faces(ChunkColumns* cols, int x, int y, int z, int faces[6])
+{
+    faces[BLOCK_FACE_LFT] = !column_get(COLUMN_OPAQUE(cols, x - 1, z), y);
+    faces[BLOCK_FACE_RGT] = !column_get(COLUMN_OPAQUE(cols, x + 1, z), y);
+    faces[BLOCK_FACE_TOP] = !column_get(COLUMN_OPAQUE(cols, x, z), y + 1);
+    faces[BLOCK_FACE_BTM] = !column_get(COLUMN_OPAQUE(cols, x, z), y - 1);
+    faces[BLOCK_FACE_BCK] = !column_get(COLUMN_OPAQUE(cols, x, z - 1), y);
+    faces[BLOCK_FACE_FRT] = !column_get(COLUMN_OPAQUE(cols, x, z + 1), y);
+
+    int num_visible = 0;
+    for (int i = 0; i < 6; i++)
+        num_visible += faces[i];
+    return num_visible;
+}
+
+/*
+Bit i is set if neighbour i is opaque (view towards -Y):
+
+----> +X   Top layer   Middle layer   Bottom layer
+|          18 21 24    9  12 15       0 3 6
+v          19 22 25    10 13 16       1 4 7
++Z         20 23 26    11 14 17       2 5 8
+*/
+static uint32_t block_get_opaque_neighs(ChunkColumns* cols, int x, int y, int z)
+{
+    uint32_t opaque_neighs = 0;
+    int const word = y >> 6;
+    int const shift = y & 63;
+
+    for (int dx = -1; dx <= 1; dx++)
+    for (int dz = -1; dz <= 1; dz++)
+    {
+        // Bits y, y + 1 and y + 2 of column are blocks below, at and above
+        uint64_t const* column = COLUMN_OPAQUE(cols, x + dx, z + dz);
+        uint64_t bits = column[word] >> shift;
+        if (shift > 61)
+            bits |= column[word + 1] << (64 - shift);
+
+        int const index = (dx + 1) * 3 + dz + 1;
+        opaque_neighs |= (uint32_t)(( bits       & 1) << index) 
+                       | (uint32_t)(((bits >> 1) & 1) << (index + 9))
+                       | (uint32_t)(((bits >> 2) & 1) << (index + 18));
+    }
+
+    return opaque_neighs;
+}
+
+static void block_set_ao(uint32_t opaque_neighs, float ao[6][4])
 {       
     // Neighbours indices for each vertex for each face
     static const unsigned char lookup[6][4][3] = 
@@ -100,146 +317,736 @@ static void block_set_ao(unsigned char neighs[27], float ao[6][4])
         { { 2,  5, 11}, {20, 23, 11}, { 8,  5, 17}, {26, 17, 23} }, // front
     };
 
-    static const float curve[4] = { 0.0f, 0.33f, 0.66f, 1.0f };
+    // Indexed by corner | side1 << 1 | side2 << 2, two
+    // sides fully occlude corner whatever it is
+    static const float curve[8] = { 0.0f, 0.33f, 0.33f, 0.66f, 0.33f, 0.66f, 1.0f, 1.0f };
 
     for (int f = 0; f < 6; f++)
     for (int v = 0; v < 4; v++)
     {
-        int corner = block_is_transparent(neighs[lookup[f][v][0]]) ? 0 : 1;
-        int side1  = block_is_transparent(neighs[lookup[f][v][1]]) ? 0 : 1;
-        int side2  = block_is_transparent(neighs[lookup[f][v][2]]) ? 0 : 1;
+        int corner = (opaque_neighs >> lookup[f][v][0]) & 1;
+        int side1  = (opaque_neighs >> lookup[f][v][1]) & 1;
+        int side2  = (opaque_neighs >> lookup[f][v][2]) & 1;
 
-        ao[f][v] = side1 && side2 ? curve[3] : curve[corner + side1 + side2];
+        ao[f][v] = curve[corner | side1 << 1 | side2 << 2];
     }
 }
 
-void chunk_generate_mesh(Chunk* c)
+// Flood fill non-opaque blocks of slice, every filled region
+// connects all slice faces that it touches
+static void slice_find_connections(ChunkColumns* cols, int slice, int num_opaque, 
+                                   unsigned char* visited, int* queue, 
+                                   uint8_t connections[6])
 {
-    c->generated_mesh_terrain = malloc(
-        CHUNK_WIDTH * CHUNK_WIDTH * CHUNK_HEIGHT * 36 * sizeof(Vertex));
-    c->generated_mesh_water = malloc(
-        CHUNK_WIDTH * CHUNK_WIDTH * CHUNK_HEIGHT * 36 * sizeof(Vertex));
+    int const y0 = slice * CHUNK_SLICE_HEIGHT;
+    int const height = MIN(CHUNK_SLICE_HEIGHT, CHUNK_HEIGHT - y0);
+    int const num_blocks = CHUNK_WIDTH * CHUNK_WIDTH * height;
 
-    if (!c->generated_mesh_terrain || !c->generated_mesh_water) 
+    memset(connections, 0, 6);
+    if (num_opaque == num_blocks)
+        return;
+
+    if (num_opaque == 0)
     {
-        fprintf(stderr, "Ran out of RAM, decrease amount of worker threads!\n");
-        exit(EXIT_FAILURE);
+        memset(connections, CHUNK_SLICE_ALL_FACES, 6);
+        return;
     }
 
-    int curr_vertex_land_count = 0;
-    int curr_vertex_water_count = 0;
-    
-    for (int x = 0; x < CHUNK_WIDTH; x++)
-    for (int y = 0; y < CHUNK_HEIGHT; y++)
-    for (int z = 0; z < CHUNK_WIDTH; z++)
+    memset(visited, 0, num_blocks);
+
+    // Local index is (x * height + y) * width + z
+    int const stride_x = height * CHUNK_WIDTH;
+    int const stride_y = CHUNK_WIDTH;
+
+    for (int start = 0; start < num_blocks; start++)
     {
-        unsigned char block = c->blocks[XYZ(x, y, z)];
+        if (visited[start])
+            continue;
+
+        int const sx = start / stride_x;
+        int const sy = start / stride_y % height;
+        int const sz = start % CHUNK_WIDTH;
+        if (column_get(COLUMN_OPAQUE(cols, sx, sz), y0 + sy))
+            continue;
+
+        uint8_t faces = 0;
+        int head = 0, tail = 0;
+        queue[tail++] = start;
+        visited[start] = 1;
+
+        while (head < tail)
+        {
+            int const i = queue[head++];
+            int const x = i / stride_x;
+            int const y = i / stride_y % height;
+            int const z = i % CHUNK_WIDTH;
+
+            if (x == 0)                faces |= 1 << BLOCK_FACE_LFT;
+            if (x == CHUNK_WIDTH - 1)  faces |= 1 << BLOCK_FACE_RGT;
+            if (y == 0)                faces |= 1 << BLOCK_FACE_BTM;
+            if (y == height - 1)       faces |= 1 << BLOCK_FACE_TOP;
+            if (z == 0)                faces |= 1 << BLOCK_FACE_BCK;
+            if (z == CHUNK_WIDTH - 1)  faces |= 1 << BLOCK_FACE_FRT;
+
+            int const neighs[6][4] = 
+            {
+                { x - 1, y, z, i - stride_x }, { x + 1, y, z, i + stride_x },
+                { x, y - 1, z, i - stride_y }, { x, y + 1, z, i + stride_y },
+                { x, y, z - 1, i - 1        }, { x, y, z + 1, i + 1        },
+            };
+
+            for (int n = 0; n < 6; n++)
+            {
+                int const nx = neighs[n][0];
+                int const ny = neighs[n][1];
+                int const nz = neighs[n][2];
+                int const ni = neighs[n][3];
+
+                if (nx < 0 || nx >= CHUNK_WIDTH || ny < 0 || ny >= height || 
+                    nz < 0 || nz >= CHUNK_WIDTH || visited[ni])
+                {
+                    continue;
+                }
+
+                if (!column_get(COLUMN_OPAQUE(cols, nx, nz), y0 + ny))
+                {
+                    visited[ni] = 1;
+                    queue[tail++] = ni;
+                }
+            }
+        }
+
+        for (int f = 0; f < 6; f++)
+        {
+            if (faces & (1 << f))
+                connections[f] |= faces;
+        }
+    }
+}
+
+// Block that represents cell of size^3 blocks: the highest
+// block that isn't a plant, so surfaces keep their top texture
+static unsigned char lod_get_cell_block(Chunk* c, int x, int y, int z, int size)
+{
+    for (int dy = MIN(size, CHUNK_HEIGHT - y) - 1; dy >= 0; dy--)
+    for (int dx = 0; dx < size; dx++)
+    for (int dz = 0; dz < size; dz++)
+    {
+        unsigned char block = c->blocks[XYZ(x + dx, y + dy, z + dz)];
+        if (block != BLOCK_AIR && !block_is_plant(block))
+            return block;
+    }
+    return BLOCK_AIR;
+}
+
+// Face of cell on chunk border is visible if any of
+// neighbour chunk's blocks along it would show it
+static int lod_border_face_is_visible(Chunk* c, unsigned char block, int face,
+                                      int x, int y, int z, int size)
+{
+    int const height = MIN(size, CHUNK_HEIGHT - y);
+
+    for (int i = 0; i < size; i++)
+    for (int j = 0; j < size; j++)
+    {
+        int bx = x, by = y, bz = z;
+        switch (face)
+        {
+            case BLOCK_FACE_LFT: bx = x - 1;    by = y + MIN(i, height - 1); bz = z + j; break;
+            case BLOCK_FACE_RGT: bx = x + size; by = y + MIN(i, height - 1); bz = z + j; break;
+            case BLOCK_FACE_TOP: by = y + height; bx = x + i; bz = z + j; break;
+            case BLOCK_FACE_BTM: by = y - 1;      bx = x + i; bz = z + j; break;
+            case BLOCK_FACE_BCK: bz = z - 1;    by = y + MIN(i, height - 1); bx = x + j; break;
+            case BLOCK_FACE_FRT: bz = z + size; by = y + MIN(i, height - 1); bx = x + j; break;
+        }
+
+        unsigned char neigh = c->blocks[XYZ(bx, by, bz)];
+        if (block_is_transparent(neigh) && block != neigh)
+            return 1;
+    }
+    return 0;
+}
+
+// Mesh of cells instead of blocks. Faces between cells use cells' blocks,
+// faces on chunk border look at neighbour's blocks. Cells are rounded up,
+// so side faces on border are extended one cell down as skirts to hide
+// cracks next to chunks with another level of detail
+static void chunk_generate_lod_mesh(Chunk* c, unsigned char* cells, int* vertex_land_count, 
+                                    int* vertex_water_count, int* min_y, int* max_y)
+{
+    int const size = 1 << c->lod;
+    int const cells_w = CHUNK_WIDTH / size;
+    int const cells_h = (CHUNK_HEIGHT + size - 1) / size;
+
+#define CELL(x, y, z) cells[((x) * cells_h + (y)) * cells_w + (z)]
+
+    for (int x = 0; x < cells_w; x++)
+    for (int y = 0; y < cells_h; y++)
+    for (int z = 0; z < cells_w; z++)
+        CELL(x, y, z) = lod_get_cell_block(c, x * size, y * size, z * size, size);
+
+    static const int offsets[6][3] =
+    {
+        { -1,  0,  0 }, {  1,  0,  0 }, {  0,  1,  0 },
+        {  0, -1,  0 }, {  0,  0, -1 }, {  0,  0,  1 },
+    };
+
+    float const cell_size = size * BLOCK_SIZE;
+    float ao[6][4] = { { 0.0f } };
+
+    // Far chunks are seen from outside, caves don't matter there
+    unsigned char light[6];
+    memset(light, LIGHT_FULL_SKY, sizeof(light));
+
+    int lowest = cells_h;
+    int highest = -1;
+
+    for (int x = 0; x < cells_w; x++)
+    for (int y = 0; y < cells_h; y++)
+    for (int z = 0; z < cells_w; z++)
+    {
+        unsigned char block = CELL(x, y, z);
         if (block == BLOCK_AIR)
             continue;
 
         int faces[6];
-        int num_visible = block_set_visible_faces(c, x, y, z, faces);
+        int num_visible = 0;
+        for (int f = 0; f < 6; f++)
+        {
+            int const nx = x + offsets[f][0];
+            int const ny = y + offsets[f][1];
+            int const nz = z + offsets[f][2];
+
+            if (nx < 0 || nx >= cells_w || ny < 0 || ny >= cells_h || nz < 0 || nz >= cells_w)
+            {
+                faces[f] = lod_border_face_is_visible(c, block, f, x * size, 
+                                                      y * size, z * size, size);
+            }
+            else
+            {
+                unsigned char neigh = CELL(nx, ny, nz);
+                faces[f] = block_is_transparent(neigh) && block != neigh;
+            }
+            num_visible += faces[f];
+        }
 
         if (num_visible == 0)
             continue;
 
-        unsigned char b_neighs[27];
-        block_get_neighs(c, x, y, z, b_neighs);
+        Vertex* mesh = c->generated_mesh_terrain;
+        int* count = vertex_land_count;
+        int make_shorter = 0;
+        if (block == BLOCK_WATER)
+        {
+            mesh = c->generated_mesh_water;
+            count = vertex_water_count;
+            make_shorter = (y == cells_h - 1 || CELL(x, y + 1, z) == BLOCK_AIR);
+        }
 
-        float ao[6][4];
-        block_set_ao(b_neighs, ao);
+        int const cx = x + c->x * cells_w;
+        int const cz = z + c->z * cells_w;
+        gen_cube_vertices(mesh, count, cx, y, cz, block, cell_size, make_shorter, 
+                          faces, ao, light);
 
-        int bx = x + (c->x * CHUNK_WIDTH);
-        int by = y;
-        int bz = z + (c->z * CHUNK_WIDTH);
+        lowest = MIN(lowest, y);
+        highest = MAX(highest, y);
 
-        if (block == BLOCK_WATER)
+        if (y == 0 || block == BLOCK_WATER)
+            continue;
+
+        // Skirts are needed only where cell below doesn't have its own face
+        int skirt_faces[6] = { 0 };
+        int num_skirts = 0;
+        unsigned char below = CELL(x, y - 1, z);
+        for (int f = 0; f < 6; f++)
         {
-            unsigned char block_above = c->blocks[XYZ(x, y + 1, z)];
-            int make_shorter = (block_above == BLOCK_AIR);
+            if (f == BLOCK_FACE_TOP || f == BLOCK_FACE_BTM || !faces[f])
+                continue;
+
+            int const nx = x + offsets[f][0];
+            int const nz = z + offsets[f][2];
+            if (nx >= 0 && nx < cells_w && nz >= 0 && nz < cells_w)
+                continue;
+
+            if (below != BLOCK_AIR && lod_border_face_is_visible(c, below, f, x * size, 
+                                                                  (y - 1) * size, z * size, size))
+            {
+                continue;
+            }
 
-            gen_cube_vertices(c->generated_mesh_water, &curr_vertex_water_count, bx, 
-                              by, bz, block, BLOCK_SIZE, make_shorter, faces, ao);
+            skirt_faces[f] = 1;
+            num_skirts++;
         }
-        else
+
+        if (num_skirts)
+        {
+            gen_cube_vertices(mesh, count, cx, y - 1, cz, block, cell_size, 0, 
+                              skirt_faces, ao, light);
+            lowest = MIN(lowest, y - 1);
+        }
+    }
+
+#undef CELL
+
+    *min_y = lowest * size;
+    *max_y = MIN((highest + 1) * size, CHUNK_HEIGHT) - 1;
+}
+
+static void shadow_push_vertex(float* mesh, int* count, int const p[3], int cx, int cz)
+{
+    float* v = &mesh[(*count)++ * 3];
+    v[0] = (p[0] + cx * CHUNK_WIDTH) * BLOCK_SIZE;
+    v[1] = p[1] * BLOCK_SIZE;
+    v[2] = (p[2] + cz * CHUNK_WIDTH) * BLOCK_SIZE;
+}
+
+// Shadow pass needs only depth, so faces of opaque blocks are merged
+// into rectangles, layer by layer for each direction. Faces turned
+// away from light are still skipped by face culling. Bit f of
+// face_bits[] is set if face f of block is visible
+static void chunk_generate_shadow_mesh(Chunk* c, unsigned char* face_bits, unsigned char* mask,
+                                       int min_y, int max_y, float* mesh, int* vertex_count)
+{
+    // Axis that is perpendicular to face and if face looks along it
+    static const int face_axis[6] = { 0, 0, 1, 1, 2, 2 };
+    static const int face_sign[6] = { 0, 1, 1, 0, 0, 1 };
+
+    // Only blocks between min_y and max_y have visible faces
+    int const lo[3] = { 0, min_y, 0 };
+    int const hi[3] = { CHUNK_WIDTH, max_y + 1, CHUNK_WIDTH };
+#define FACE_BITS(p) face_bits[((p)[0] * CHUNK_HEIGHT + (p)[1]) * CHUNK_WIDTH + (p)[2]]
+
+    for (int f = 0; f < 6; f++)
+    {
+        // Axes are in cyclic order, so u x v points along d
+        int const d = face_axis[f];
+        int const u = (d + 1) % 3;
+        int const v = (d + 2) % 3;
+        int const du = hi[u] - lo[u];
+        int const dv = hi[v] - lo[v];
+
+        for (int layer = lo[d]; layer < hi[d]; layer++)
+        {
+            int p[3];
+            p[d] = layer;
+            int num_faces = 0;
+            for (p[v] = lo[v]; p[v] < hi[v]; p[v]++)
+            for (p[u] = lo[u]; p[u] < hi[u]; p[u]++)
+            {
+                int const i = (p[v] - lo[v]) * du + p[u] - lo[u];
+                mask[i] = (FACE_BITS(p) >> f) & 1;
+                num_faces += mask[i];
+            }
+
+            if (num_faces == 0)
+                continue;
+
+            for (int b = 0; b < dv; b++)
+            for (int a = 0; a < du; a++)
+            {
+                if (!mask[b * du + a])
+                    continue;
+
+                int w = 1;
+                while (a + w < du && mask[b * du + a + w])
+                    w++;
+
+                int h = 1;
+                for (; b + h < dv; h++)
+                {
+                    int k = 0;
+                    while (k < w && mask[(b + h) * du + a + k])
+                        k++;
+                    if (k < w)
+                        break;
+                }
+
+                for (int j = 0; j < h; j++)
+                    memset(&mask[(b + j) * du + a], 0, w);
+
+                int corners[4][3];
+                for (int i = 0; i < 4; i++)
+                {
+                    corners[i][d] = layer + face_sign[f];
+                    corners[i][u] = lo[u] + a + ((i == 1 || i == 2) ? w : 0);
+                    corners[i][v] = lo[v] + b + ((i == 2 || i == 3) ? h : 0);
+                }
+
+                // Counter-clockwise when looking at face from outside
+                static const int order_pos[6] = { 0, 1, 2, 0, 2, 3 };
+                static const int order_neg[6] = { 0, 2, 1, 0, 3, 2 };
+                int const* order = face_sign[f] ? order_pos : order_neg;
+                for (int i = 0; i < 6; i++)
+                    shadow_push_vertex(mesh, vertex_count, corners[order[i]], c->x, c->z);
+            }
+        }
+    }
+
+#undef FACE_BITS
+}
+
+ChunkMeshBuffers* chunk_mesh_buffers_create()
+{
+    // Pages of vertex buffers that meshes never reach
+    // aren't touched, so they don't take physical memory
+    size_t const max_vertices = (size_t)CHUNK_WIDTH * CHUNK_WIDTH * CHUNK_HEIGHT * 36;
+    int const words = get_column_words();
+    int const slice_size = CHUNK_WIDTH * CHUNK_WIDTH * CHUNK_SLICE_HEIGHT;
+
+    ChunkMeshBuffers* b = malloc(sizeof(ChunkMeshBuffers));
+    b->terrain = malloc(max_vertices * sizeof(Vertex));
+    b->water = malloc(max_vertices * sizeof(Vertex));
+    b->shadow = malloc(max_vertices * 3 * sizeof(float));
+    b->shadow_alpha = malloc(max_vertices * sizeof(Vertex));
+
+    b->face_bits = malloc(CHUNK_WIDTH * CHUNK_WIDTH * CHUNK_HEIGHT);
+    b->columns_opaque = malloc(CHUNK_WIDTH_REAL * CHUNK_WIDTH_REAL * words * sizeof(uint64_t));
+    b->columns_candidates = malloc(CHUNK_WIDTH * CHUNK_WIDTH * words * sizeof(uint64_t));
+    b->columns_layers = malloc(CHUNK_WIDTH * words * sizeof(uint64_t));
+    b->columns_transparent = malloc(CHUNK_WIDTH * CHUNK_WIDTH * words * sizeof(uint64_t));
+    b->columns_inside = malloc(words * sizeof(uint64_t));
+
+    // The finest level of detail has the most cells
+    b->lod_cells = malloc(CHUNK_WIDTH * CHUNK_WIDTH * CHUNK_HEIGHT);
+    b->shadow_mask = malloc(CHUNK_WIDTH * CHUNK_HEIGHT);
+    b->visited = malloc(slice_size);
+    b->queue = malloc(slice_size * sizeof(int));
+
+    if (!b->terrain || !b->water || !b->shadow || !b->shadow_alpha || !b->face_bits)
+    {
+        fprintf(stderr, "Ran out of RAM, decrease amount of worker threads!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return b;
+}
+
+void chunk_mesh_buffers_destroy(ChunkMeshBuffers* b)
+{
+    free(b->terrain);
+    free(b->water);
+    free(b->shadow);
+    free(b->shadow_alpha);
+    free(b->face_bits);
+    free(b->columns_opaque);
+    free(b->columns_candidates);
+    free(b->columns_layers);
+    free(b->columns_transparent);
+    free(b->columns_inside);
+    free(b->lod_cells);
+    free(b->shadow_mask);
+    free(b->visited);
+    free(b->queue);
+    free(b);
+}
+
+void chunk_generate_mesh(Chunk* c, ChunkMeshBuffers* buffers)
+{
+    c->generated_mesh_terrain = buffers->terrain;
+    c->generated_mesh_water = buffers->water;
+    c->generated_mesh_shadow = buffers->shadow;
+    c->generated_mesh_shadow_alpha = buffers->shadow_alpha;
+
+    unsigned char* face_bits = buffers->face_bits;
+    memset(face_bits, 0, CHUNK_WIDTH * CHUNK_WIDTH * CHUNK_HEIGHT);
+
+    int curr_vertex_land_count = 0;
+    int curr_vertex_water_count = 0;
+    int curr_vertex_shadow_count = 0;
+    int curr_vertex_shadow_alpha_count = 0;
+
+    int min_y = CHUNK_HEIGHT;
+    int max_y = -1;
+
+    int opaque_in_slice[CHUNK_MAX_SLICES] = { 0 };
+    int const num_slices = MIN(chunk_get_num_slices(), CHUNK_MAX_SLICES);
+
+    ChunkColumns cols;
+    chunk_columns_build(c, buffers, &cols, opaque_in_slice, num_slices);
+
+    // Distance in blocks array to neighbour in direction of each face
+    int const light_face_offsets[6] =
+    {
+        -CHUNK_WIDTH_REAL * CHUNK_HEIGHT_REAL, CHUNK_WIDTH_REAL * CHUNK_HEIGHT_REAL,
+        CHUNK_WIDTH_REAL, -CHUNK_WIDTH_REAL, -1, 1
+    };
+    
+    // Order of blocks is the same as in blocks array,
+    // layers of x without any candidates are skipped
+    for (int x = 0; x < CHUNK_WIDTH; x++)
+    for (int y = 0; y < CHUNK_HEIGHT; y++)
+    {
+        if (!column_get(&cols.layers[x * cols.words], y))
+            continue;
+
+        for (int z = 0; z < CHUNK_WIDTH; z++)
         {
-            if (block_is_plant(block))
+            if (!column_get(&cols.candidates[(x * CHUNK_WIDTH + z) * cols.words], y))
+                continue;
+
+            unsigned char block = c->blocks[XYZ(x, y, z)];
+            int const is_opaque = column_get(COLUMN_OPAQUE(&cols, x, z), y);
+
+            // Transparent blocks don't show faces to the same blocks
+            int faces[6];
+            int num_visible = is_opaque ? opaque_block_set_visible_faces(&cols, x, y, z, faces)
+                                        : block_set_visible_faces(c, x, y, z, faces);
+
+            if (num_visible == 0)
+                continue;
+
+            if (y < min_y) min_y = y;
+            if (y > max_y) max_y = y;
+
+            // Mesh is made of merged blocks below
+            if (c->lod > 0)
+                continue;
+
+            float ao[6][4];
+            block_set_ao(block_get_opaque_neighs(&cols, x, y, z), ao);
+
+            // Face is lit by block in front of it
+            unsigned char light[6];
+            int const index = XYZ(x, y, z);
+            for (int f = 0; f < 6; f++)
+                light[f] = c->light[index + light_face_offsets[f]];
+
+            int bx = x + (c->x * CHUNK_WIDTH);
+            int by = y;
+            int bz = z + (c->z * CHUNK_WIDTH);
+
+            if (block == BLOCK_WATER)
             {
-                gen_plant_vertices(c->generated_mesh_terrain, &curr_vertex_land_count, 
-                                   bx, by, bz, block, BLOCK_SIZE);
+                unsigned char block_above = c->blocks[XYZ(x, y + 1, z)];
+                int make_shorter = (block_above == BLOCK_AIR);
+
+                gen_cube_vertices(c->generated_mesh_water, &curr_vertex_water_count, bx, 
+                                  by, bz, block, BLOCK_SIZE, make_shorter, faces, ao, light);
             }
             else
             {
-                gen_cube_vertices(c->generated_mesh_terrain, &curr_vertex_land_count, 
-                                  bx, by, bz, block, BLOCK_SIZE, 0, faces, ao);
+                int const first_vertex = curr_vertex_land_count;
+
+                if (block_is_plant(block))
+                {
+                    gen_plant_vertices(c->generated_mesh_terrain, &curr_vertex_land_count, 
+                                       bx, by, bz, block, BLOCK_SIZE, c->light[index]);
+                }
+                else
+                {
+                    gen_cube_vertices(c->generated_mesh_terrain, &curr_vertex_land_count, 
+                                      bx, by, bz, block, BLOCK_SIZE, 0, faces, ao, light);
+                }
+
+                // Leaves, glass, cactus and plants need alpha test in shadow pass
+                if (!is_opaque)
+                {
+                    int const num = curr_vertex_land_count - first_vertex;
+                    memcpy(&c->generated_mesh_shadow_alpha[curr_vertex_shadow_alpha_count],
+                           &c->generated_mesh_terrain[first_vertex], num * sizeof(Vertex));
+                    curr_vertex_shadow_alpha_count += num;
+                }
+                else
+                {
+                    unsigned char bits = 0;
+                    for (int f = 0; f < 6; f++)
+                        bits |= faces[f] << f;
+                    face_bits[(x * CHUNK_HEIGHT + y) * CHUNK_WIDTH + z] = bits;
+                }
             }
         }
+    }
+
+    if (c->lod > 0)
+    {
+        chunk_generate_lod_mesh(c, buffers->lod_cells, &curr_vertex_land_count, &curr_vertex_water_count, 
+                                &min_y, &max_y);
 
+        // Merged cells are coarse enough, positions are taken as is
+        for (int i = 0; i < curr_vertex_land_count; i++)
+            memcpy(&c->generated_mesh_shadow[i * 3], c->generated_mesh_terrain[i].pos, 
+                   3 * sizeof(float));
+        curr_vertex_shadow_count = curr_vertex_land_count;
+    }
+    else
+    {
+        chunk_generate_shadow_mesh(c, face_bits, buffers->shadow_mask, min_y, max_y, 
+                                   c->generated_mesh_shadow, &curr_vertex_shadow_count);
     }
 
     c->vertex_land_count = curr_vertex_land_count;
     c->vertex_water_count = curr_vertex_water_count;
-}
+    c->vertex_shadow_count = curr_vertex_shadow_count;
+    c->vertex_shadow_alpha_count = curr_vertex_shadow_alpha_count;
 
-void chunk_upload_mesh_to_gpu(Chunk* c)
-{
-    if (c->is_generated)
+    // Will be applied on upload, chunk may 
+    // be rendered with old mesh until then
+    c->generated_min_y = min_y;
+    c->generated_max_y = max_y;
+
+    c->generated_opaque_slices = 0;
+    for (int i = 0; i < num_slices; i++)
     {
-        glDeleteVertexArrays(2, (const GLuint[]){c->VAO_land, c->VAO_water});
-        glDeleteBuffers(2, (const GLuint[]){c->VBO_land, c->VBO_water});
+        if (opaque_in_slice[i] == CHUNK_WIDTH * CHUNK_WIDTH * CHUNK_SLICE_HEIGHT)
+            c->generated_opaque_slices |= 1u << i;
     }
 
-    c->VAO_land = opengl_create_vao();
-    c->VBO_land = opengl_create_vbo(c->generated_mesh_terrain, c->vertex_land_count * sizeof(Vertex));
-    free(c->generated_mesh_terrain);
-    c->generated_mesh_terrain = NULL;
+    for (int i = 0; i < num_slices; i++)
+    {
+        slice_find_connections(&cols, i, opaque_in_slice[i], buffers->visited, buffers->queue, 
+                               c->generated_slice_connections[i]);
+    }
+}
+
+static void chunk_remove_water(Chunk* c)
+{
+    if (c->water_arena)
+        mesh_arena_remove(c->water_arena, c->water_arena_first, c->water_arena_count);
+
+    c->water_arena = NULL;
+    c->water_arena_count = 0;
+}
+
+static void set_vertex_layout()
+{
     opengl_vbo_layout(0, 3, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 0);
     opengl_vbo_layout(1, 2, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 3 * sizeof(float));
     opengl_vbo_layout(2, 1, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 5 * sizeof(float));
     opengl_vbo_layout(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float));
     opengl_vbo_layout(4, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float) + 1);
+    opengl_vbo_layout(5, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float) + 2);
+}
+
+// VAO and VBO are created once per pool slot, later meshes only
+// replace data. Returns 1 if they were created and VAO is bound
+static int upload_buffer(GLuint* VAO, GLuint* VBO, const void* data, size_t size)
+{
+    if (*VAO)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, *VBO);
+        glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+        return 0;
+    }
 
-    c->VAO_water = opengl_create_vao();
-    c->VBO_water = opengl_create_vbo(c->generated_mesh_water, c->vertex_water_count * sizeof(Vertex));
-    free(c->generated_mesh_water);
+    *VAO = opengl_create_vao();
+    *VBO = opengl_create_vbo(data, size);
+    return 1;
+}
+
+void chunk_upload_mesh_to_gpu(Chunk* c, MeshArena* water_arena)
+{
+    if (upload_buffer(&c->VAO_land, &c->VBO_land, c->generated_mesh_terrain, 
+                      c->vertex_land_count * sizeof(Vertex)))
+        set_vertex_layout();
+    c->generated_mesh_terrain = NULL;
+
+    chunk_remove_water(c);
+    if (c->vertex_water_count)
+    {
+        c->water_arena = water_arena;
+        c->water_arena_count = c->vertex_water_count;
+        c->water_arena_first = mesh_arena_add(water_arena, c->generated_mesh_water, 
+                                              c->water_arena_count);
+    }
     c->generated_mesh_water = NULL;
-    opengl_vbo_layout(0, 3, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 0);
-    opengl_vbo_layout(1, 2, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 3 * sizeof(float));
-    opengl_vbo_layout(2, 1, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 5 * sizeof(float));
-    opengl_vbo_layout(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float));
-    opengl_vbo_layout(4, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float) + 1);
 
-    c->is_generated = 1;
+    if (upload_buffer(&c->VAO_shadow, &c->VBO_shadow, c->generated_mesh_shadow, 
+                      c->vertex_shadow_count * 3 * sizeof(float)))
+        opengl_vbo_layout(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
+    c->generated_mesh_shadow = NULL;
+
+    if (upload_buffer(&c->VAO_shadow_alpha, &c->VBO_shadow_alpha, 
+                      c->generated_mesh_shadow_alpha, 
+                      c->vertex_shadow_alpha_count * sizeof(Vertex)))
+        set_vertex_layout();
+    c->generated_mesh_shadow_alpha = NULL;
+
+    c->min_y = c->generated_min_y;
+    c->max_y = c->generated_max_y;
+    c->opaque_slices = c->generated_opaque_slices;
+    c->mesh_lod = c->lod;
+    memcpy(c->slice_connections, c->generated_slice_connections, 
+           sizeof(c->slice_connections));
+
+    c->has_mesh = 1;
 }
 
-int chunk_is_visible(int cx, int cz, vec4 planes[6])
+static int chunk_part_is_visible(int cx, int cz, int min_y, int max_y, vec4 planes[6])
 {
-    // Construct chunk aabb
+    if (max_y < min_y)
+        return 0;
+
+    // Construct aabb of blocks from min_y to max_y
     vec3 aabb[2];
     aabb[0][0] = cx * CHUNK_SIZE;
-    aabb[0][1] = 0.0f;
+    aabb[0][1] = min_y * BLOCK_SIZE;
     aabb[0][2] = cz * CHUNK_SIZE;
     aabb[1][0] = aabb[0][0] + CHUNK_SIZE;
-    aabb[1][1] = CHUNK_HEIGHT * BLOCK_SIZE;
+    aabb[1][1] = (max_y + 1) * BLOCK_SIZE;
     aabb[1][2] = aabb[0][2] + CHUNK_SIZE;
 
     return glm_aabb_frustum(aabb, planes);
 }
 
-void chunk_delete(Chunk* c)
+int chunk_is_visible(int cx, int cz, vec4 planes[6])
 {
-    if (c->is_generated)
-    {
-        glDeleteVertexArrays(2, (const GLuint[]){c->VAO_land, c->VAO_water});
-        glDeleteBuffers(2, (const GLuint[]){c->VBO_land, c->VBO_water});
-        free(c->blocks);
-    }
+    return chunk_part_is_visible(cx, cz, 0, CHUNK_HEIGHT - 1, planes);
+}
+
+int chunk_mesh_is_visible(Chunk* c, vec4 planes[6])
+{
+    return chunk_part_is_visible(c->x, c->z, c->min_y, c->max_y, planes);
+}
+
+void chunk_get_mesh_aabb(Chunk* c, vec3 aabb[2])
+{
+    aabb[0][0] = c->x * CHUNK_SIZE;
+    aabb[0][1] = c->min_y * BLOCK_SIZE;
+    aabb[0][2] = c->z * CHUNK_SIZE;
+    aabb[1][0] = aabb[0][0] + CHUNK_SIZE;
+    aabb[1][1] = (c->max_y + 1) * BLOCK_SIZE;
+    aabb[1][2] = aabb[0][2] + CHUNK_SIZE;
+}
 
-    if (c->generated_mesh_terrain)
+int chunk_get_occluders(Chunk* c, vec3 boxes[CHUNK_MAX_SLICES][2])
+{
+    int num_boxes = 0;
+    uint32_t const slices = c->opaque_slices;
+
+    int i = 0;
+    while (i < CHUNK_MAX_SLICES)
     {
-        free(c->generated_mesh_terrain);
-        free(c->generated_mesh_water);
+        if (!(slices & (1u << i)))
+        {
+            i++;
+            continue;
+        }
+
+        // Merge consecutive slices into one box
+        int first = i;
+        while (i < CHUNK_MAX_SLICES && (slices & (1u << i)))
+            i++;
+
+        boxes[num_boxes][0][0] = c->x * CHUNK_SIZE;
+        boxes[num_boxes][0][1] = first * CHUNK_SLICE_HEIGHT * BLOCK_SIZE;
+        boxes[num_boxes][0][2] = c->z * CHUNK_SIZE;
+        boxes[num_boxes][1][0] = (c->x + 1) * CHUNK_SIZE;
+        boxes[num_boxes][1][1] = i * CHUNK_SLICE_HEIGHT * BLOCK_SIZE;
+        boxes[num_boxes][1][2] = (c->z + 1) * CHUNK_SIZE;
+        num_boxes++;
     }
 
-    free(c);
+    return num_boxes;
+}
+
+void chunk_delete(Chunk* c)
+{
+    // GPU objects stay in pool slot for the next chunk
+    chunk_remove_water(c);
+    if (c->blocks)
+        chunk_pool_release_buffer(c->blocks);
+    if (c->light)
+        chunk_pool_release_buffer(c->light);
+
+    chunk_pool_release(c);
 }
@@ -9,43 +9,219 @@
 
 #include <utils.h>
 #include <config.h>
+#include <map/mesh_arena.h>
 
 // Access block by 3 coords from 1-dimensional array
 #define XYZ(x, y, z)   (((x) + 1) * CHUNK_WIDTH_REAL * CHUNK_HEIGHT_REAL) \
                      + (((y) + 1) * CHUNK_WIDTH_REAL)                     \
                      +  ((z) + 1)                                          
 
+// Chunk is split into slices of this height for occlusion
+// culling, fully opaque slices are used as occluders
+#define CHUNK_SLICE_HEIGHT 16
+#define CHUNK_MAX_SLICES   32
+
+// All 6 faces of slice, bits are BLOCK_FACE_* values
+#define CHUNK_SLICE_ALL_FACES 0x3F
+
+// Far chunks are meshed from cells of 2^lod blocks
+#define CHUNK_MAX_LOD 2
+
+// Lifecycle of chunk. Main thread hands chunk to worker in GENERATING
+// or MESHING and moves it to idle GENERATED or READY when job is done.
+// Worker only moves it from GENERATING to MESHING. UNLOADING may be set
+// at any time, worker skips the rest of its job then and chunk is
+// deleted as soon as no worker uses it
+typedef enum
+{
+    CHUNK_REQUESTED,
+    CHUNK_GENERATING,
+    CHUNK_GENERATED,
+    CHUNK_MESHING,
+    CHUNK_READY,
+    CHUNK_UNLOADING
+}
+ChunkState;
+
 typedef struct
 {
     unsigned char* blocks;
     int x, z;
 
+    // Same layout as blocks, see light.h
+    unsigned char* light;
+
+    // XYZ() indices of blocks changed since the last mesh,
+    // light of them is updated before the next one
+    int* light_edits;
+    int num_light_edits;
+    int light_edits_capacity;
+
+    // Amount of workers that read light of chunk, it
+    // can't be deleted while it's used by neighbours
+    int num_readers;
+
+    // ChunkState, changed only with atomic functions below
+    volatile int state;
+
+    // Blocks have changed since the last mesh
     int is_dirty;
-    int is_generated;
-    int is_safe_to_modify;
+
+    // Mesh was uploaded at least once, chunk can be drawn
+    int has_mesh;
+
+    // When chunk left unload radius, 0 if it's inside of it
+    uint64_t out_of_range_ns;
+
+    // Level of detail for the next mesh, set before meshing
+    // starts. mesh_lod is level of the uploaded mesh
+    int lod;
+    int mesh_lod;
 
     GLuint VAO_land;
     GLuint VBO_land;
-    GLuint VAO_water;
-    GLuint VBO_water;
     size_t vertex_land_count;
     size_t vertex_water_count;
 
+    // Water of all chunks shares one buffer, so it can be drawn
+    // sorted by one call. Arena is NULL if chunk has no water
+    MeshArena* water_arena;
+    int water_arena_first;
+    int water_arena_count;
+
+    // Meshes for shadow pass. Opaque faces are merged into big
+    // quads of positions only, blocks with see-through texture
+    // keep full vertices for alpha test
+    GLuint VAO_shadow;
+    GLuint VBO_shadow;
+    GLuint VAO_shadow_alpha;
+    GLuint VBO_shadow_alpha;
+    size_t vertex_shadow_count;
+    size_t vertex_shadow_alpha_count;
+
+    // Lowest and highest blocks that have visible
+    // faces, max_y < min_y if mesh is empty
+    int min_y, max_y;
+
+    // Bit i is set if slice i has only opaque blocks
+    uint32_t opaque_slices;
+
+    // Bit g of slice_connections[s][f] is set if face f of
+    // slice s is connected to face g through non-opaque blocks
+    uint8_t slice_connections[CHUNK_MAX_SLICES][6];
+
+    // Result of CPU occlusion culling in this frame
+    int is_occluded;
+
+    // Set if cave culling reached any slice in this frame
+    int is_cave_visible;
+
+    // Query with chunk's bounding box, issued after terrain
+    // is rendered. Conditional rendering in the next frame
+    // skips chunk if none of the box was visible
+    GLuint occlusion_query;
+    int occlusion_query_frame;
+
+    // Point to ChunkMeshBuffers of mesher until upload
     Vertex* generated_mesh_terrain;
     Vertex* generated_mesh_water;
+    float* generated_mesh_shadow;
+    Vertex* generated_mesh_shadow_alpha;
+    int generated_min_y, generated_max_y;
+    uint32_t generated_opaque_slices;
+    uint8_t generated_slice_connections[CHUNK_MAX_SLICES][6];
 }
 Chunk;
 
+// Memory of one mesher, allocated once and reused for every
+// mesh. Generated mesh stays in it until it's uploaded, so
+// the next chunk can be meshed only after that
+typedef struct
+{
+    Vertex* terrain;
+    Vertex* water;
+    float* shadow;
+    Vertex* shadow_alpha;
+
+    // Scratch that is used only during chunk_generate_mesh()
+    unsigned char* face_bits;
+    uint64_t* columns_opaque;
+    uint64_t* columns_candidates;
+    uint64_t* columns_layers;
+    uint64_t* columns_transparent;
+    uint64_t* columns_inside;
+    unsigned char* lod_cells;
+    unsigned char* shadow_mask;
+    unsigned char* visited;
+    int* queue;
+}
+ChunkMeshBuffers;
+
 Chunk* chunk_init(int cx, int cz);
 
+static inline ChunkState chunk_get_state(Chunk* c)
+{
+    return (ChunkState)atomic_load_int(&c->state);
+}
+
+static inline void chunk_set_state(Chunk* c, ChunkState state)
+{
+    atomic_store_int(&c->state, state);
+}
+
+// Returns 0 if chunk is not in state from anymore
+static inline int chunk_try_set_state(Chunk* c, ChunkState from, ChunkState to)
+{
+    return atomic_cas_int(&c->state, from, to);
+}
+
+// Worker is writing blocks, light or mesh of chunk
+static inline int chunk_is_busy(Chunk* c)
+{
+    ChunkState const state = chunk_get_state(c);
+    return state == CHUNK_GENERATING || state == CHUNK_MESHING;
+}
+
+// Blocks are fully generated and are not going to be deleted
+static inline int chunk_has_blocks(Chunk* c)
+{
+    ChunkState const state = chunk_get_state(c);
+    return state == CHUNK_GENERATED || state == CHUNK_MESHING || state == CHUNK_READY;
+}
+
+// Amount of slices covering whole chunk height, last one may
+// be lower. Can be more than CHUNK_MAX_SLICES for high chunks
+static inline int chunk_get_num_slices()
+{
+    return (CHUNK_HEIGHT + CHUNK_SLICE_HEIGHT - 1) / CHUNK_SLICE_HEIGHT;
+}
+
 void chunk_generate_terrain(Chunk* c);
 
-void chunk_generate_mesh(Chunk* c);
+ChunkMeshBuffers* chunk_mesh_buffers_create();
+
+void chunk_mesh_buffers_destroy(ChunkMeshBuffers* buffers);
 
-void chunk_upload_mesh_to_gpu(Chunk* c);
+void chunk_generate_mesh(Chunk* c, ChunkMeshBuffers* buffers);
 
+// Block at XYZ() index has changed, light around it needs update
+void chunk_add_light_edit(Chunk* c, int index);
+
+// Water mesh is added to water_arena
+void chunk_upload_mesh_to_gpu(Chunk* c, MeshArena* water_arena);
+
+// Test full-height column of chunk, e.g. if
+// chunk is not loaded or meshed yet
 int chunk_is_visible(int cx, int cz, vec4 planes[6]);
 
+// Test only blocks that are present in chunk mesh
+int chunk_mesh_is_visible(Chunk* c, vec4 planes[6]);
+
+void chunk_get_mesh_aabb(Chunk* c, vec3 aabb[2]);
+
+// Boxes of consecutive opaque slices, returns their amount
+int chunk_get_occluders(Chunk* c, vec3 boxes[CHUNK_MAX_SLICES][2]);
+
 void chunk_delete(Chunk* c);
 
 // Hash functions used in chunk hashmap
@@ -0,0 +1,182 @@
+#include <map/chunk_pool.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <tinycthread.h>
+
+static struct
+{
+    Chunk* slab;
+    int capacity;
+
+    // Indices of free slots, used as a stack
+    int* free_slots;
+    int num_free_slots;
+    int peak_used;
+
+    // Released chunks from outside of slab, used as a stack
+    Chunk** free_overflow;
+    int num_free_overflow;
+    int free_overflow_capacity;
+    int num_overflow;
+
+    // Workers take buffers when they generate terrain
+    unsigned char** free_buffers;
+    int num_free_buffers;
+    int free_buffers_capacity;
+    int num_buffers;
+    mtx_t buffers_mtx;
+}
+pool;
+
+static int is_in_slab(Chunk* c)
+{
+    return c >= pool.slab && c < pool.slab + pool.capacity;
+}
+
+static void delete_gpu_objects(Chunk* c)
+{
+    if (c->VAO_land)
+    {
+        glDeleteVertexArrays(3, (const GLuint[]){c->VAO_land, c->VAO_shadow, 
+                                                 c->VAO_shadow_alpha});
+        glDeleteBuffers(3, (const GLuint[]){c->VBO_land, c->VBO_shadow, 
+                                            c->VBO_shadow_alpha});
+    }
+    if (c->occlusion_query)
+        glDeleteQueries(1, &c->occlusion_query);
+}
+
+void chunk_pool_init(int capacity)
+{
+    // Zeroed slots have no GPU objects and no light edits yet
+    pool.slab = calloc(capacity, sizeof(Chunk));
+    pool.capacity = capacity;
+
+    pool.free_slots = malloc(capacity * sizeof(int));
+    pool.num_free_slots = capacity;
+    for (int i = 0; i < capacity; i++)
+        pool.free_slots[i] = capacity - 1 - i;
+    pool.peak_used = 0;
+
+    pool.free_overflow = NULL;
+    pool.num_free_overflow = 0;
+    pool.free_overflow_capacity = 0;
+    pool.num_overflow = 0;
+
+    // Every chunk has blocks and light
+    pool.free_buffers_capacity = 2 * capacity;
+    pool.free_buffers = malloc(pool.free_buffers_capacity * sizeof(unsigned char*));
+    pool.num_free_buffers = 0;
+    pool.num_buffers = 0;
+    mtx_init(&pool.buffers_mtx, mtx_plain);
+}
+
+Chunk* chunk_pool_acquire()
+{
+    if (pool.num_free_slots == 0)
+    {
+        pool.num_overflow++;
+        if (pool.num_free_overflow)
+            return pool.free_overflow[--pool.num_free_overflow];
+        return calloc(1, sizeof(Chunk));
+    }
+
+    Chunk* c = &pool.slab[pool.free_slots[--pool.num_free_slots]];
+    pool.peak_used = MAX(pool.peak_used, pool.capacity - pool.num_free_slots);
+    return c;
+}
+
+void chunk_pool_release(Chunk* c)
+{
+    if (is_in_slab(c))
+    {
+        pool.free_slots[pool.num_free_slots++] = c - pool.slab;
+        return;
+    }
+
+    if (pool.num_free_overflow == pool.free_overflow_capacity)
+    {
+        pool.free_overflow_capacity = MAX(16, 2 * pool.free_overflow_capacity);
+        pool.free_overflow = realloc(pool.free_overflow, 
+                                     pool.free_overflow_capacity * sizeof(Chunk*));
+    }
+    pool.free_overflow[pool.num_free_overflow++] = c;
+    pool.num_overflow--;
+}
+
+unsigned char* chunk_pool_acquire_buffer()
+{
+    mtx_lock(&pool.buffers_mtx);
+    unsigned char* buffer = NULL;
+    if (pool.num_free_buffers)
+        buffer = pool.free_buffers[--pool.num_free_buffers];
+    else
+        pool.num_buffers++;
+    mtx_unlock(&pool.buffers_mtx);
+
+    if (!buffer)
+        buffer = malloc(CHUNK_WIDTH_REAL * CHUNK_WIDTH_REAL * CHUNK_HEIGHT_REAL);
+    return buffer;
+}
+
+void chunk_pool_release_buffer(unsigned char* buffer)
+{
+    mtx_lock(&pool.buffers_mtx);
+    if (pool.num_free_buffers == pool.free_buffers_capacity)
+    {
+        pool.free_buffers_capacity *= 2;
+        pool.free_buffers = realloc(pool.free_buffers, 
+                                    pool.free_buffers_capacity * sizeof(unsigned char*));
+    }
+    pool.free_buffers[pool.num_free_buffers++] = buffer;
+    mtx_unlock(&pool.buffers_mtx);
+}
+
+void chunk_pool_get_stats(ChunkPoolStats* stats)
+{
+    stats->capacity = pool.capacity;
+    stats->num_used = pool.capacity - pool.num_free_slots;
+    stats->peak_used = pool.peak_used;
+    stats->num_overflow = pool.num_overflow;
+    stats->num_free_overflow = pool.num_free_overflow;
+
+    mtx_lock(&pool.buffers_mtx);
+    stats->num_buffers = pool.num_buffers;
+    stats->num_free_buffers = pool.num_free_buffers;
+    mtx_unlock(&pool.buffers_mtx);
+}
+
+void chunk_pool_free()
+{
+    for (int i = 0; i < pool.capacity; i++)
+    {
+        delete_gpu_objects(&pool.slab[i]);
+        free(pool.slab[i].light_edits);
+    }
+    free(pool.slab);
+    free(pool.free_slots);
+
+    for (int i = 0; i < pool.num_free_overflow; i++)
+    {
+        delete_gpu_objects(pool.free_overflow[i]);
+        free(pool.free_overflow[i]->light_edits);
+        free(pool.free_overflow[i]);
+    }
+    free(pool.free_overflow);
+
+    for (int i = 0; i < pool.num_free_buffers; i++)
+        free(pool.free_buffers[i]);
+    free(pool.free_buffers);
+    mtx_destroy(&pool.buffers_mtx);
+
+    pool.slab = NULL;
+    pool.capacity = 0;
+    pool.num_free_slots = 0;
+    pool.free_overflow = NULL;
+    pool.num_free_overflow = 0;
+    pool.free_overflow_capacity = 0;
+    pool.num_overflow = 0;
+    pool.num_free_buffers = 0;
+    pool.num_buffers = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef CHUNK_POOL_H_
+#define CHUNK_POOL_H_
+
+#include <map/chunk.h>
+
+// Chunks live in one slab sized for all chunks inside of unload
+// radius. Deleted chunk gives its slot back with GPU buffers still
+// allocated, so the next chunk in that slot only replaces their
+// data. Block and light buffers of deleted chunks are recycled too.
+// Only when slab is full chunks are allocated one by one, these are
+// kept with their GPU buffers after release for the next overflow.
+//
+// Chunk* c = chunk_pool_acquire();
+// c->blocks = chunk_pool_acquire_buffer();
+//     ...
+// chunk_pool_release_buffer(c->blocks);
+// chunk_pool_release(c);
+
+typedef struct
+{
+    int capacity;
+    int num_used;
+    int peak_used;
+
+    // Chunks outside of slab in use right now, and
+    // released ones kept for reuse
+    int num_overflow;
+    int num_free_overflow;
+
+    // Block and light buffers, both in use and free
+    int num_buffers;
+    int num_free_buffers;
+}
+ChunkPoolStats;
+
+// Capacity is amount of chunks in slab
+void chunk_pool_init(int capacity);
+
+// Slot has GPU objects of its previous chunk, other fields are garbage
+Chunk* chunk_pool_acquire();
+
+void chunk_pool_release(Chunk* c);
+
+// Buffer of CHUNK_WIDTH_REAL^2 * CHUNK_HEIGHT_REAL bytes with garbage,
+// can be called from any thread
+unsigned char* chunk_pool_acquire_buffer();
+
+void chunk_pool_release_buffer(unsigned char* buffer);
+
+void chunk_pool_get_stats(ChunkPoolStats* stats);
+
+// All chunks have to be released already
+void chunk_pool_free();
+
+#endif
@@ -0,0 +1,285 @@
+#include <map/far_terrain.h>
+
+#include <float.h>
+#include <stdlib.h>
+
+#include <map/block.h>
+#include <map/light.h>
+#include <worldgen.h>
+#include <utils.h>
+
+// Samples per tile side, at least tile corners
+static int get_tile_quads()
+{
+    return MAX(1, CHUNK_WIDTH / FAR_TERRAIN_STEP);
+}
+
+static int mod(int a, int b)
+{
+    int r = a % b;
+    return r < 0 ? r + b : r;
+}
+
+static int get_tile_index(FarTerrain* ft, int cx, int cz)
+{
+    return mod(cx, ft->side) * ft->side + mod(cz, ft->side);
+}
+
+static FarTerrainTile* get_tile(FarTerrain* ft, int cx, int cz)
+{
+    return &ft->tiles[get_tile_index(ft, cx, cz)];
+}
+
+static void set_vertex(Vertex* v, vec3 pos, float u, float w, unsigned char block, int face)
+{
+    glm_vec3_copy(pos, v->pos);
+    v->tex_coord[0] = u;
+    v->tex_coord[1] = w;
+    v->ao = 0.0f;
+    v->tile = block_textures[block][face];
+    v->normal = face;
+    v->light = LIGHT_FULL_SKY;
+}
+
+// Triangles (p0, p1, p2) and (p2, p1, p3)
+static void push_quad(Vertex* vertices, int* count, vec3 p[4], vec2 uv[4], 
+                      unsigned char block, int face)
+{
+    static const int order[6] = { 0, 1, 2, 2, 1, 3 };
+    for (int i = 0; i < 6; i++)
+    {
+        int const k = order[i];
+        set_vertex(&vertices[(*count)++], p[k], uv[k][0], uv[k][1], block, face);
+    }
+}
+
+// Quad hanging down from edge (a, b), facing along normal
+static void push_skirt(Vertex* vertices, int* count, vec3 a, vec3 b, 
+                       vec3 normal, unsigned char block, int face)
+{
+    float const depth = FAR_TERRAIN_SKIRT * BLOCK_SIZE;
+
+    vec3 p[4];
+    glm_vec3_copy(a, p[0]);
+    glm_vec3_copy(a, p[1]);
+    glm_vec3_copy(b, p[2]);
+    glm_vec3_copy(b, p[3]);
+    p[1][1] -= depth;
+    p[3][1] -= depth;
+
+    // Fix winding, so skirt is not removed by face culling
+    vec3 e1, e2, n;
+    glm_vec3_sub(p[1], p[0], e1);
+    glm_vec3_sub(p[2], p[0], e2);
+    glm_vec3_cross(e1, e2, n);
+    if (glm_vec3_dot(n, normal) < 0.0f)
+    {
+        glm_vec3_copy(b, p[0]);
+        glm_vec3_copy(b, p[1]);
+        glm_vec3_copy(a, p[2]);
+        glm_vec3_copy(a, p[3]);
+        p[1][1] -= depth;
+        p[3][1] -= depth;
+    }
+
+    float const len = glm_vec3_distance(a, b) / BLOCK_SIZE;
+    vec2 uv[4] = { { 0.0f, 0.0f }, { 0.0f, -FAR_TERRAIN_SKIRT }, 
+                   { len,  0.0f }, { len,  -FAR_TERRAIN_SKIRT } };
+    push_quad(vertices, count, p, uv, block, face);
+}
+
+static void build_tile(FarTerrain* ft, int cx, int cz, Vertex* vertices)
+{
+    int const quads = get_tile_quads();
+    int const step = CHUNK_WIDTH / quads;
+    int const n = quads + 1;
+
+    int* heights = malloc(n * n * sizeof(int));
+    unsigned char* blocks = malloc(n * n);
+    vec3* points = malloc(n * n * sizeof(vec3));
+
+    FarTerrainTile* tile = get_tile(ft, cx, cz);
+    tile->min_y = FLT_MAX;
+    tile->max_y = -FLT_MAX;
+
+    for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+    {
+        int const bx = cx * CHUNK_WIDTH + i * step;
+        int const bz = cz * CHUNK_WIDTH + j * step;
+        worldgen_get_surface(bx, bz, &heights[i * n + j], &blocks[i * n + j]);
+
+        // Top of the highest block, water is a bit lower
+        float y = heights[i * n + j] + 1.0f;
+        if (blocks[i * n + j] == BLOCK_WATER)
+            y -= 0.125f;
+
+        points[i * n + j][0] = bx * BLOCK_SIZE;
+        points[i * n + j][1] = y * BLOCK_SIZE;
+        points[i * n + j][2] = bz * BLOCK_SIZE;
+
+        tile->min_y = MIN(tile->min_y, points[i * n + j][1]);
+        tile->max_y = MAX(tile->max_y, points[i * n + j][1]);
+    }
+    tile->min_y -= FAR_TERRAIN_SKIRT * BLOCK_SIZE;
+
+    int count = 0;
+#define P(i, j) points[(i) * n + (j)]
+
+    for (int i = 0; i < quads; i++)
+    for (int j = 0; j < quads; j++)
+    {
+        // Texture repeats every block
+        vec3 p[4];
+        vec2 uv[4];
+        int const corners[4][2] = { { i, j }, { i, j + 1 }, { i + 1, j }, { i + 1, j + 1 } };
+        for (int k = 0; k < 4; k++)
+        {
+            glm_vec3_copy(P(corners[k][0], corners[k][1]), p[k]);
+            uv[k][0] = corners[k][0] * step;
+            uv[k][1] = corners[k][1] * step;
+        }
+        push_quad(vertices, &count, p, uv, blocks[i * n + j], BLOCK_FACE_TOP);
+    }
+
+    for (int k = 0; k < quads; k++)
+    {
+        push_skirt(vertices, &count, P(0, k), P(0, k + 1), 
+                   (vec3){ -1.0f, 0.0f, 0.0f }, blocks[k], BLOCK_FACE_LFT);
+        push_skirt(vertices, &count, P(quads, k), P(quads, k + 1), 
+                   (vec3){ 1.0f, 0.0f, 0.0f }, blocks[quads * n + k], BLOCK_FACE_RGT);
+        push_skirt(vertices, &count, P(k, 0), P(k + 1, 0), 
+                   (vec3){ 0.0f, 0.0f, -1.0f }, blocks[k * n], BLOCK_FACE_BCK);
+        push_skirt(vertices, &count, P(k, quads), P(k + 1, quads), 
+                   (vec3){ 0.0f, 0.0f, 1.0f }, blocks[k * n + quads], BLOCK_FACE_FRT);
+    }
+#undef P
+
+    free(heights);
+    free(blocks);
+    free(points);
+
+    tile->cx = cx;
+    tile->cz = cz;
+    tile->is_built = 1;
+}
+
+FarTerrain* far_terrain_create(int radius)
+{
+    FarTerrain* ft = malloc(sizeof(FarTerrain));
+
+    int const quads = get_tile_quads();
+    ft->radius = radius;
+    ft->side = 2 * radius + 1;
+    ft->vertices_per_tile = 6 * (quads * quads + 4 * quads);
+
+    int const num_tiles = ft->side * ft->side;
+    ft->tiles = malloc(num_tiles * sizeof(FarTerrainTile));
+    ft->draw_firsts = malloc(num_tiles * sizeof(GLint));
+    ft->draw_counts = malloc(num_tiles * sizeof(GLsizei));
+    far_terrain_invalidate(ft);
+
+    ft->VAO = opengl_create_vao();
+    glGenBuffers(1, &ft->VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ft->VBO);
+    glBufferData(GL_ARRAY_BUFFER, (size_t)num_tiles * ft->vertices_per_tile * sizeof(Vertex), 
+                 NULL, GL_DYNAMIC_DRAW);
+    opengl_vbo_layout(0, 3, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 0);
+    opengl_vbo_layout(1, 2, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 3 * sizeof(float));
+    opengl_vbo_layout(2, 1, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 5 * sizeof(float));
+    opengl_vbo_layout(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float));
+    opengl_vbo_layout(4, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float) + 1);
+    opengl_vbo_layout(5, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float) + 2);
+
+    return ft;
+}
+
+void far_terrain_update(FarTerrain* ft, int player_cx, int player_cz)
+{
+    Vertex* vertices = NULL;
+    int num_built = 0;
+
+    glBindBuffer(GL_ARRAY_BUFFER, ft->VBO);
+
+    // Square rings around player, so closer tiles go first
+    for (int r = 0; r <= ft->radius && num_built < FAR_TERRAIN_TILES_PER_FRAME; r++)
+    for (int dx = -r; dx <= r && num_built < FAR_TERRAIN_TILES_PER_FRAME; dx++)
+    for (int dz = -r; dz <= r && num_built < FAR_TERRAIN_TILES_PER_FRAME; dz++)
+    {
+        if (abs(dx) != r && abs(dz) != r)
+            continue;
+        if (dx * dx + dz * dz > ft->radius * ft->radius)
+            continue;
+
+        int const cx = player_cx + dx;
+        int const cz = player_cz + dz;
+        FarTerrainTile* tile = get_tile(ft, cx, cz);
+        if (tile->is_built && tile->cx == cx && tile->cz == cz)
+            continue;
+
+        if (!vertices)
+            vertices = malloc(ft->vertices_per_tile * sizeof(Vertex));
+
+        build_tile(ft, cx, cz, vertices);
+        glBufferSubData(GL_ARRAY_BUFFER, 
+            (size_t)get_tile_index(ft, cx, cz) * ft->vertices_per_tile * sizeof(Vertex),
+            ft->vertices_per_tile * sizeof(Vertex), vertices);
+        num_built++;
+    }
+
+    free(vertices);
+}
+
+void far_terrain_invalidate(FarTerrain* ft)
+{
+    for (int i = 0; i < ft->side * ft->side; i++)
+        ft->tiles[i].is_built = 0;
+}
+
+void far_terrain_render(FarTerrain* ft, int player_cx, int player_cz, 
+                        vec4 planes[6], FarTerrainHasChunk has_chunk)
+{
+    int num_draws = 0;
+
+    for (int dx = -ft->radius; dx <= ft->radius; dx++)
+    for (int dz = -ft->radius; dz <= ft->radius; dz++)
+    {
+        if (dx * dx + dz * dz > ft->radius * ft->radius)
+            continue;
+
+        int const cx = player_cx + dx;
+        int const cz = player_cz + dz;
+        FarTerrainTile* tile = get_tile(ft, cx, cz);
+        if (!tile->is_built || tile->cx != cx || tile->cz != cz)
+            continue;
+
+        vec3 aabb[2] =
+        {
+            { cx * CHUNK_SIZE, tile->min_y, cz * CHUNK_SIZE },
+            { (cx + 1) * CHUNK_SIZE, tile->max_y, (cz + 1) * CHUNK_SIZE },
+        };
+        if (!glm_aabb_frustum(aabb, planes) || has_chunk(cx, cz))
+            continue;
+
+        ft->draw_firsts[num_draws] = get_tile_index(ft, cx, cz) * ft->vertices_per_tile;
+        ft->draw_counts[num_draws] = ft->vertices_per_tile;
+        num_draws++;
+    }
+
+    if (num_draws == 0)
+        return;
+
+    glBindVertexArray(ft->VAO);
+    glMultiDrawArrays(GL_TRIANGLES, ft->draw_firsts, ft->draw_counts, num_draws);
+}
+
+void far_terrain_destroy(FarTerrain* ft)
+{
+    glDeleteVertexArrays(1, &ft->VAO);
+    glDeleteBuffers(1, &ft->VBO);
+
+    free(ft->tiles);
+    free(ft->draw_firsts);
+    free(ft->draw_counts);
+    free(ft);
+}
@@ -0,0 +1,66 @@
+#ifndef FAR_TERRAIN_H_
+#define FAR_TERRAIN_H_
+
+#include <glad/glad.h>
+#include <cglm/cglm.h>
+
+// Coarse heightfield beyond loaded chunks, made only from worldgen
+// height and biome noise. There's one tile per chunk column, tiles
+// live in fixed slots of a single buffer (slot is chunk coordinates
+// modulo square side), so moving player rebuilds only tiles that
+// entered the square, and all tiles are drawn by one call.
+
+// Distance between heightfield samples in blocks
+#define FAR_TERRAIN_STEP 16
+
+// How deep tile borders go down to hide cracks, in blocks
+#define FAR_TERRAIN_SKIRT 16
+
+// Tiles built per far_terrain_update() call
+#define FAR_TERRAIN_TILES_PER_FRAME 32
+
+typedef struct
+{
+    // Chunk that slot was built for
+    int cx, cz;
+    int is_built;
+
+    float min_y, max_y;
+}
+FarTerrainTile;
+
+typedef struct
+{
+    GLuint VAO;
+    GLuint VBO;
+
+    int radius;
+    int side;
+    int vertices_per_tile;
+    FarTerrainTile* tiles;
+
+    GLint* draw_firsts;
+    GLsizei* draw_counts;
+}
+FarTerrain;
+
+// Returns 1 if chunk has its own mesh and tile isn't needed
+typedef int (*FarTerrainHasChunk)(int cx, int cz);
+
+// Radius in chunks, tiles cover whole circle,
+// including chunks that aren't loaded yet
+FarTerrain* far_terrain_create(int radius);
+
+// Build missing tiles around player, the closest first
+void far_terrain_update(FarTerrain* ft, int player_cx, int player_cz);
+
+// Rebuild everything, e.g. after seed change
+void far_terrain_invalidate(FarTerrain* ft);
+
+// Uses currently bound shader, which has to accept Vertex layout
+void far_terrain_render(FarTerrain* ft, int player_cx, int player_cz, 
+                        vec4 planes[6], FarTerrainHasChunk has_chunk);
+
+void far_terrain_destroy(FarTerrain* ft);
+
+#endif
@@ -0,0 +1,493 @@
+#include <map/light.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <map/block.h>
+
+// Sky light is stored in lower 4 bits, light of blocks in upper 4
+#define SHIFT_SKY   0
+#define SHIFT_BLOCK 4
+
+// Coordinates here are of blocks array, so halo is at 0 and at
+// CHUNK_WIDTH_REAL - 1 (CHUNK_HEIGHT_REAL - 1 for y)
+typedef struct
+{
+    short x, y, z;
+    unsigned char value;
+}
+LightNode;
+
+typedef struct
+{
+    LightNode* nodes;
+    int head, tail;
+    int capacity;
+}
+LightQueue;
+
+typedef struct
+{
+    Chunk* chunk;
+    int shift;
+    LightQueue removal;
+    LightQueue add;
+
+    // Halo blocks that lost light of chunk, neighbours may still
+    // have it from before. They stay dark until neighbours remove it
+    LightQueue dark_halo;
+}
+LightContext;
+
+// In BLOCK_FACE_* order
+static const int offsets[6][3] =
+{
+    { -1,  0,  0 }, {  1,  0,  0 }, {  0,  1,  0 },
+    {  0, -1,  0 }, {  0,  0, -1 }, {  0,  0,  1 },
+};
+
+static inline int get_index(int x, int y, int z)
+{
+    return (x * CHUNK_HEIGHT_REAL + y) * CHUNK_WIDTH_REAL + z;
+}
+
+static inline int is_inside(int x, int y, int z)
+{
+    return x >= 0 && x < CHUNK_WIDTH_REAL && y >= 0 && y < CHUNK_HEIGHT_REAL
+        && z >= 0 && z < CHUNK_WIDTH_REAL;
+}
+
+static inline int is_halo_column(int x, int z)
+{
+    return x == 0 || x == CHUNK_WIDTH_REAL - 1 || z == 0 || z == CHUNK_WIDTH_REAL - 1;
+}
+
+// If any of channels of light a is brighter than in b
+static inline int is_brighter(unsigned char a, unsigned char b)
+{
+    return LIGHT_SKY(a) > LIGHT_SKY(b) || LIGHT_BLOCK(a) > LIGHT_BLOCK(b);
+}
+
+static inline int get_light(LightContext* ctx, int index)
+{
+    return (ctx->chunk->light[index] >> ctx->shift) & LIGHT_MAX;
+}
+
+static inline void set_light(LightContext* ctx, int index, int value)
+{
+    unsigned char* light = &ctx->chunk->light[index];
+    *light = (*light & ~(LIGHT_MAX << ctx->shift)) | (value << ctx->shift);
+}
+
+static inline int get_emitted_light(LightContext* ctx, int index)
+{
+    return ctx->shift == SHIFT_BLOCK ? block_get_light(ctx->chunk->blocks[index]) : 0;
+}
+
+static void queue_push(LightQueue* q, int x, int y, int z, int value)
+{
+    if (q->tail == q->capacity)
+    {
+        // Reuse space of popped nodes first
+        if (q->head > 0)
+        {
+            memmove(q->nodes, &q->nodes[q->head], (q->tail - q->head) * sizeof(LightNode));
+            q->tail -= q->head;
+            q->head = 0;
+        }
+        else
+        {
+            q->capacity = q->capacity ? q->capacity * 2 : 4096;
+            q->nodes = realloc(q->nodes, q->capacity * sizeof(LightNode));
+        }
+    }
+
+    LightNode* n = &q->nodes[q->tail++];
+    n->x = x;
+    n->y = y;
+    n->z = z;
+    n->value = value;
+}
+
+static void context_init(LightContext* ctx, Chunk* c, int shift)
+{
+    memset(ctx, 0, sizeof(LightContext));
+    ctx->chunk = c;
+    ctx->shift = shift;
+}
+
+static void context_free(LightContext* ctx)
+{
+    free(ctx->removal.nodes);
+    free(ctx->add.nodes);
+    free(ctx->dark_halo.nodes);
+}
+
+// Value that light of node gives to its neighbour in direction of face
+static inline int get_spread_value(LightContext* ctx, int value, int face)
+{
+    if (ctx->shift == SHIFT_SKY && face == BLOCK_FACE_BTM && value == LIGHT_MAX)
+        return LIGHT_MAX;
+    return value - 1;
+}
+
+// Spread light from nodes of add queue to transparent neighbours
+static void propagate(LightContext* ctx)
+{
+    LightQueue* q = &ctx->add;
+    unsigned char* blocks = ctx->chunk->blocks;
+
+    while (q->head < q->tail)
+    {
+        LightNode n = q->nodes[q->head++];
+        int const value = get_light(ctx, get_index(n.x, n.y, n.z));
+        if (value <= 1)
+            continue;
+
+        for (int f = 0; f < 6; f++)
+        {
+            int const x = n.x + offsets[f][0];
+            int const y = n.y + offsets[f][1];
+            int const z = n.z + offsets[f][2];
+            if (!is_inside(x, y, z))
+                continue;
+
+            int const index = get_index(x, y, z);
+            if (!block_is_transparent(blocks[index]))
+                continue;
+
+            int const spread = get_spread_value(ctx, value, f);
+            if (get_light(ctx, index) < spread)
+            {
+                set_light(ctx, index, spread);
+                queue_push(q, x, y, z, spread);
+            }
+        }
+    }
+
+    q->head = q->tail = 0;
+}
+
+// Darken everything that got light from nodes of removal queue, those
+// nodes are already dark. Neighbours lit from elsewhere are added to
+// add queue, so propagate() fills removed area back from them
+static void remove_light(LightContext* ctx)
+{
+    LightQueue* q = &ctx->removal;
+
+    while (q->head < q->tail)
+    {
+        LightNode n = q->nodes[q->head++];
+
+        for (int f = 0; f < 6; f++)
+        {
+            int const x = n.x + offsets[f][0];
+            int const y = n.y + offsets[f][1];
+            int const z = n.z + offsets[f][2];
+            if (!is_inside(x, y, z))
+                continue;
+
+            int const index = get_index(x, y, z);
+            int const value = get_light(ctx, index);
+            if (value == 0)
+                continue;
+
+            if (value < n.value || get_spread_value(ctx, n.value, f) == LIGHT_MAX)
+            {
+                set_light(ctx, index, 0);
+                queue_push(q, x, y, z, value);
+                if (is_halo_column(x, z))
+                    queue_push(&ctx->dark_halo, x, y, z, 0);
+
+                // Light source stays lit whatever happens around
+                int const emitted = get_emitted_light(ctx, index);
+                if (emitted)
+                {
+                    set_light(ctx, index, emitted);
+                    queue_push(&ctx->add, x, y, z, emitted);
+                }
+            }
+            else
+            {
+                queue_push(&ctx->add, x, y, z, value);
+            }
+        }
+    }
+
+    q->head = q->tail = 0;
+}
+
+// Sky light is full above the highest opaque block of every column.
+// Below that it comes from sides, so only sky blocks next to higher
+// columns have to be propagated
+static void compute_sky(LightContext* ctx)
+{
+    Chunk* c = ctx->chunk;
+
+    int* tops = malloc(CHUNK_WIDTH_REAL * CHUNK_WIDTH_REAL * sizeof(int));
+    for (int x = 0; x < CHUNK_WIDTH_REAL; x++)
+    for (int z = 0; z < CHUNK_WIDTH_REAL; z++)
+    {
+        int y = CHUNK_HEIGHT_REAL - 1;
+        while (y >= 0 && block_is_transparent(c->blocks[get_index(x, y, z)]))
+        {
+            set_light(ctx, get_index(x, y, z), LIGHT_MAX);
+            y--;
+        }
+        tops[x * CHUNK_WIDTH_REAL + z] = y;
+    }
+
+    for (int x = 0; x < CHUNK_WIDTH_REAL; x++)
+    for (int z = 0; z < CHUNK_WIDTH_REAL; z++)
+    {
+        int const top = tops[x * CHUNK_WIDTH_REAL + z];
+        int highest_neigh = top;
+        for (int f = 0; f < 6; f++)
+        {
+            int const nx = x + offsets[f][0];
+            int const nz = z + offsets[f][2];
+            if (offsets[f][1] == 0 && is_inside(nx, 0, nz))
+                highest_neigh = MAX(highest_neigh, tops[nx * CHUNK_WIDTH_REAL + nz]);
+        }
+
+        for (int y = top + 1; y <= highest_neigh; y++)
+            queue_push(&ctx->add, x, y, z, LIGHT_MAX);
+    }
+
+    free(tops);
+    propagate(ctx);
+}
+
+static void compute_blocks(LightContext* ctx)
+{
+    Chunk* c = ctx->chunk;
+
+    for (int x = 0; x < CHUNK_WIDTH_REAL; x++)
+    for (int y = 0; y < CHUNK_HEIGHT_REAL; y++)
+    for (int z = 0; z < CHUNK_WIDTH_REAL; z++)
+    {
+        int const index = get_index(x, y, z);
+        int const emitted = block_get_light(c->blocks[index]);
+        if (emitted)
+        {
+            set_light(ctx, index, emitted);
+            queue_push(&ctx->add, x, y, z, emitted);
+        }
+    }
+
+    propagate(ctx);
+}
+
+void light_compute(Chunk* c)
+{
+    memset(c->light, 0, CHUNK_WIDTH_REAL * CHUNK_WIDTH_REAL * CHUNK_HEIGHT_REAL);
+
+    LightContext ctx;
+    context_init(&ctx, c, SHIFT_SKY);
+    compute_sky(&ctx);
+
+    ctx.shift = SHIFT_BLOCK;
+    compute_blocks(&ctx);
+
+    context_free(&ctx);
+}
+
+// Neighbour that owns halo column of chunk, NULL if there is no such
+// neighbour. Coordinates are of blocks array, nx and nz are set to
+// coordinates of the same column in neighbour
+static Chunk* get_halo_owner(Chunk* neighs[9], int x, int z, int* nx, int* nz)
+{
+    int const dx = (x == 0) ? -1 : (x == CHUNK_WIDTH_REAL - 1) ? 1 : 0;
+    int const dz = (z == 0) ? -1 : (z == CHUNK_WIDTH_REAL - 1) ? 1 : 0;
+    if (dx == 0 && dz == 0)
+        return NULL;
+
+    Chunk* n = neighs[LIGHT_NEIGH(dx, dz)];
+    if (!n || !n->light)
+        return NULL;
+
+    *nx = x - dx * CHUNK_WIDTH;
+    *nz = z - dz * CHUNK_WIDTH;
+    return n;
+}
+
+static void update_channel(LightContext* ctx, Chunk* neighs[9], int* edits, int num_edits)
+{
+    // Changed blocks and halo blocks that got darker in
+    // neighbours lose their light together with blocks lit by them
+    for (int i = 0; i < num_edits; i++)
+    {
+        int const index = edits[i];
+        int const x = index / (CHUNK_HEIGHT_REAL * CHUNK_WIDTH_REAL);
+        int const y = index / CHUNK_WIDTH_REAL % CHUNK_HEIGHT_REAL;
+        int const z = index % CHUNK_WIDTH_REAL;
+
+        int const value = get_light(ctx, index);
+        if (value)
+        {
+            set_light(ctx, index, 0);
+            queue_push(&ctx->removal, x, y, z, value);
+        }
+    }
+
+    for (int x = 0; x < CHUNK_WIDTH_REAL; x++)
+    for (int z = 0; z < CHUNK_WIDTH_REAL; z++)
+    {
+        int nx, nz;
+        if (!is_halo_column(x, z))
+            continue;
+
+        Chunk* n = get_halo_owner(neighs, x, z, &nx, &nz);
+        if (!n)
+            continue;
+
+        for (int y = 1; y < CHUNK_HEIGHT_REAL - 1; y++)
+        {
+            int const index = get_index(x, y, z);
+            int const value = get_light(ctx, index);
+            int const target = (n->light[get_index(nx, y, nz)] >> ctx->shift) & LIGHT_MAX;
+            if (target < value)
+            {
+                set_light(ctx, index, 0);
+                queue_push(&ctx->removal, x, y, z, value);
+            }
+        }
+    }
+
+    remove_light(ctx);
+
+    // Changed blocks may emit light now or let it in from neighbours
+    for (int i = 0; i < num_edits; i++)
+    {
+        int const index = edits[i];
+        int const x = index / (CHUNK_HEIGHT_REAL * CHUNK_WIDTH_REAL);
+        int const y = index / CHUNK_WIDTH_REAL % CHUNK_HEIGHT_REAL;
+        int const z = index % CHUNK_WIDTH_REAL;
+
+        int const emitted = get_emitted_light(ctx, index);
+        if (emitted > get_light(ctx, index))
+        {
+            set_light(ctx, index, emitted);
+            queue_push(&ctx->add, x, y, z, emitted);
+        }
+
+        for (int f = 0; f < 6; f++)
+        {
+            int const nx = x + offsets[f][0];
+            int const ny = y + offsets[f][1];
+            int const nz = z + offsets[f][2];
+            if (is_inside(nx, ny, nz) && get_light(ctx, get_index(nx, ny, nz)))
+                queue_push(&ctx->add, nx, ny, nz, 0);
+        }
+    }
+
+    // Halo takes light of neighbours where they have more
+    for (int x = 0; x < CHUNK_WIDTH_REAL; x++)
+    for (int z = 0; z < CHUNK_WIDTH_REAL; z++)
+    {
+        int nx, nz;
+        if (!is_halo_column(x, z))
+            continue;
+
+        Chunk* n = get_halo_owner(neighs, x, z, &nx, &nz);
+        if (!n)
+            continue;
+
+        for (int y = 1; y < CHUNK_HEIGHT_REAL - 1; y++)
+        {
+            int const index = get_index(x, y, z);
+            int const target = (n->light[get_index(nx, y, nz)] >> ctx->shift) & LIGHT_MAX;
+            if (target > get_light(ctx, index))
+            {
+                set_light(ctx, index, target);
+                queue_push(&ctx->add, x, y, z, target);
+            }
+        }
+    }
+
+    LightQueue* q = &ctx->dark_halo;
+    for (int i = q->head; i < q->tail; i++)
+        set_light(ctx, get_index(q->nodes[i].x, q->nodes[i].y, q->nodes[i].z), 0);
+    q->head = q->tail = 0;
+
+    propagate(ctx);
+}
+
+void light_update(Chunk* c, Chunk* neighs[9], int* edits, int num_edits)
+{
+    LightContext ctx;
+    context_init(&ctx, c, SHIFT_SKY);
+    update_channel(&ctx, neighs, edits, num_edits);
+
+    ctx.shift = SHIFT_BLOCK;
+    update_channel(&ctx, neighs, edits, num_edits);
+
+    context_free(&ctx);
+}
+
+int light_get_outdated_neighs(Chunk* c, Chunk* neighs[9])
+{
+    int outdated = 0;
+
+    for (int dx = -1; dx <= 1; dx++)
+    for (int dz = -1; dz <= 1; dz++)
+    {
+        Chunk* n = neighs[LIGHT_NEIGH(dx, dz)];
+        if (!n || !n->light || (dx == 0 && dz == 0))
+            continue;
+
+        // Border columns of chunk that are in halo of neighbour
+        int const min_x = (dx == 1) ? CHUNK_WIDTH : 1;
+        int const max_x = (dx == -1) ? 1 : CHUNK_WIDTH;
+        int const min_z = (dz == 1) ? CHUNK_WIDTH : 1;
+        int const max_z = (dz == -1) ? 1 : CHUNK_WIDTH;
+
+        int is_outdated = 0;
+        for (int x = min_x; x <= max_x && !is_outdated; x++)
+        for (int z = min_z; z <= max_z && !is_outdated; z++)
+        {
+            int const nx = x - dx * CHUNK_WIDTH;
+            int const nz = z - dz * CHUNK_WIDTH;
+            for (int y = 1; y < CHUNK_HEIGHT_REAL - 1; y++)
+            {
+                if (c->light[get_index(x, y, z)] != n->light[get_index(nx, y, nz)])
+                {
+                    is_outdated = 1;
+                    break;
+                }
+            }
+
+            // Border of neighbour that is brighter than halo
+            int const hx = x + dx, hz = z + dz;
+            int const bx = nx + dx, bz = nz + dz;
+            for (int y = 1; y < CHUNK_HEIGHT_REAL - 1 && !is_outdated; y++)
+            {
+                if (is_brighter(n->light[get_index(bx, y, bz)], c->light[get_index(hx, y, hz)]))
+                    is_outdated = 1;
+            }
+        }
+
+        if (is_outdated)
+            outdated |= 1 << LIGHT_NEIGH(dx, dz);
+    }
+
+    return outdated;
+}
+
+void light_add_border_edits(Chunk* c, Chunk* n, int dx, int dz)
+{
+    // Halo columns of chunk next to neighbour
+    int const min_x = (dx == 1) ? CHUNK_WIDTH + 1 : (dx == -1) ? 0 : 1;
+    int const max_x = (dx == -1) ? 0 : (dx == 1) ? CHUNK_WIDTH + 1 : CHUNK_WIDTH;
+    int const min_z = (dz == 1) ? CHUNK_WIDTH + 1 : (dz == -1) ? 0 : 1;
+    int const max_z = (dz == -1) ? 0 : (dz == 1) ? CHUNK_WIDTH + 1 : CHUNK_WIDTH;
+
+    for (int x = min_x; x <= max_x; x++)
+    for (int z = min_z; z <= max_z; z++)
+    for (int y = 1; y < CHUNK_HEIGHT_REAL - 1; y++)
+    {
+        int const index = get_index(x - dx * CHUNK_WIDTH, y, z - dz * CHUNK_WIDTH);
+        if (is_brighter(n->light[index], c->light[get_index(x, y, z)]))
+            chunk_add_light_edit(n, index);
+    }
+}
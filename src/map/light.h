@@ -0,0 +1,40 @@
+#ifndef LIGHT_H_
+#define LIGHT_H_
+
+#include <map/chunk.h>
+
+// Light of block is one byte, sky light is in lower 4 bits and
+// light of blocks in upper 4. Each step through transparent
+// block takes 1 level, but sky light of 15 goes straight down
+#define LIGHT_MAX 15
+#define LIGHT_SKY(light)   ((light) & 0x0F)
+#define LIGHT_BLOCK(light) ((light) >> 4)
+
+// Open sky and nothing else, for meshes without light data
+#define LIGHT_FULL_SKY LIGHT_MAX
+
+// Neighbour chunk at (cx + dx, cz + dz) has index (dx + 1) * 3 + dz + 1,
+// index of chunk itself is LIGHT_NEIGH_SELF and is never used
+#define LIGHT_NEIGH(dx, dz) (((dx) + 1) * 3 + (dz) + 1)
+#define LIGHT_NEIGH_SELF    LIGHT_NEIGH(0, 0)
+
+// Light of chunk and its halo from their own blocks only,
+// as if there was no light in neighbour chunks
+void light_compute(Chunk* c);
+
+// Incremental update after blocks at given XYZ() indices have changed, then
+// halo takes light of neighbours that are not NULL. Only blocks that light
+// of changed ones reaches are visited, not the whole chunk
+void light_update(Chunk* c, Chunk* neighs[9], int* edits, int num_edits);
+
+// Bit i is set if neighbour i has different light in its halo than
+// chunk has on its border, or its border is brighter than halo of
+// chunk, so it has to be updated
+int light_get_outdated_neighs(Chunk* c, Chunk* neighs[9]);
+
+// Border of neighbour n at (c->x + dx, c->z + dz) that is brighter than
+// halo of chunk is added to its light edits. Light that came from chunk
+// is gone, halo of chunk is kept dark until neighbour removes it too
+void light_add_border_edits(Chunk* c, Chunk* n, int dx, int dz);
+
+#endif
@@ -2,7 +2,9 @@
 
 #include <stdlib.h>
 #include <limits.h>
+#include <float.h>
 #include <math.h>
+#include <string.h>
 
 #include <fastnoiselite.h>
 
@@ -10,15 +12,22 @@
 #include <texture.h>
 #include <utils.h>
 #include <db.h>
+#include <profiler.h>
+#include <frame_arena.h>
+#include <time_measure.h>
 #include <map/block.h>
+#include <map/chunk_pool.h>
+#include <map/light.h>
 #include <map/thread_worker.h>
+#include <map/occlusion_culler.h>
+#include <map/cave_culler.h>
+#include <map/far_terrain.h>
+#include <map/mesh_arena.h>
 #include <window.h>
 
 // Define data structures for chunks
-LINKEDLIST_DECLARATION(Chunk*, chunks);
 HASHMAP_DECLARATION(Chunk*, chunks);
 
-LINKEDLIST_IMPLEMENTATION(Chunk*, chunks);
 HASHMAP_IMPLEMENTATION(Chunk*, chunks, chunk_hash_func);
 
 // Useful defines that simplify iteration over chunks
@@ -33,19 +42,78 @@ for (int i = 0; i < map->chunks_active->array_size; i++)                 \
 #define MAP_FOREACH_ACTIVE_CHUNK_END() }}
 
 
-#define LIST_FOREACH_CHUNK_BEGIN(LIST, CHUNK_NAME) \
-{LinkedListNode_chunks* node = LIST->head;         \
-for ( ; node; node = node->ptr_next)               \
-{                                                  \
-    Chunk* c = node->data;                         \
+#define ARRAY_FOREACH_CHUNK_BEGIN(ARRAY, CHUNK_NAME)   \
+for (int i_chunk = 0; i_chunk < (ARRAY).count; i_chunk++) \
+{                                                      \
+    Chunk* CHUNK_NAME = (ARRAY).chunks[i_chunk];       \
 
-#define LIST_FOREACH_CHUNK_END() }}
+#define ARRAY_FOREACH_CHUNK_END() }
 
 
+// Initial size of shared water buffer in vertices
+#define MAP_WATER_ARENA_CAPACITY (1 << 18)
+
+// Amount of remembered mesh changes, older
+// changes are treated as changes everywhere
+#define MAP_MESH_CHANGES 256
+
+typedef struct
+{
+    int version;
+    int cx, cz;
+}
+MeshChange;
+
+// Chunk loaded again within this time after it
+// was unloaded could have been kept in memory
+#define MAP_RECENT_UNLOADS   256
+#define MAP_RELOAD_WINDOW_NS (30 * 1000000000ull)
+
+typedef struct
+{
+    int cx, cz;
+    uint64_t time_ns;
+}
+ChunkUnload;
+
+// Counters to tune unloading, printed on exit
+typedef struct
+{
+    int generated;
+    int unloaded;
+
+    // Unloaded before their mesh was ever shown
+    int unloaded_without_mesh;
+
+    // Generated again soon after they were unloaded
+    int reloaded;
+}
+ChunkStats;
+
+// Water of one chunk in transparent queue
+typedef struct
+{
+    float dist2;
+    GLint first;
+    GLsizei count;
+}
+WaterDraw;
+
+// Chunks collected during one frame, memory
+// is from frame arena or is owned by caller
+typedef struct
+{
+    Chunk** chunks;
+    int count;
+}
+ChunkArray;
+
 typedef struct
 {
     HashMap_chunks* chunks_active;
-    LinkedList_chunks* chunks_to_render;
+
+    // Valid from map_update() till the end of frame
+    ChunkArray chunks_to_render;
 
     GLuint VAO_skybox;
     GLuint VBO_skybox;
@@ -56,7 +124,46 @@ typedef struct
     Worker* workers;
     int num_workers;
 
+    // For chunks that are loaded on main thread, NULL if headless
+    ChunkMeshBuffers* mesh_buffers;
+
+    // Workers that are busy with prefetched chunks
+    int num_prefetch_jobs;
+
+    // Chunks tested by occlusion culler in this frame,
+    // index in array is object id in culler
+    OcclusionCuller* occlusion_culler;
+    Chunk** occlusion_chunks;
+    int occlusion_chunks_capacity;
+
+    CaveCuller* cave_culler;
+
+    // NULL if disabled
+    FarTerrain* far_terrain;
+
+    // Water meshes of all chunks. Visible ones are sorted back
+    // to front and drawn by one call, touching ranges are merged
+    MeshArena* water_arena;
+    WaterDraw* water_queue;
+    GLint* water_firsts;
+    GLsizei* water_counts;
+    int water_queue_capacity;
+
     int seed;
+    int is_headless;
+
+    // Number of map_render_chunks() calls
+    int frame;
+
+    // Ring of the last uploaded or deleted meshes, so
+    // cached shadow maps know if they have to be updated
+    MeshChange mesh_changes[MAP_MESH_CHANGES];
+    int mesh_version;
+
+    ChunkStats chunk_stats;
+
+    // Ring of the last unloads, indexed by chunk_stats.unloaded
+    ChunkUnload recent_unloads[MAP_RECENT_UNLOADS];
 }
 Map;
 
@@ -77,18 +184,86 @@ static Chunk* map_get_chunk(int chunk_x, int chunk_z)
     return node ? node->data : NULL;
 }
 
-static void map_delete_chunk(int chunk_x, int chunk_z)
+static void record_mesh_change(Chunk* c)
 {
-    Chunk* c = map_get_chunk(chunk_x, chunk_z);
-    if (c)
+    map->mesh_version++;
+
+    MeshChange* change = &map->mesh_changes[map->mesh_version % MAP_MESH_CHANGES];
+    change->version = map->mesh_version;
+    change->cx = c->x;
+    change->cz = c->z;
+}
+
+static void map_delete_chunk(Chunk* c)
+{
+    if (c->has_mesh)
+        record_mesh_change(c);
+
+    ChunkStats* stats = &map->chunk_stats;
+    ChunkUnload* unload = &map->recent_unloads[stats->unloaded % MAP_RECENT_UNLOADS];
+    unload->cx = c->x;
+    unload->cz = c->z;
+    unload->time_ns = time_get_ns();
+
+    stats->unloaded++;
+    if (!c->has_mesh)
+        stats->unloaded_without_mesh++;
+
+    // Culler may still be running, its result is not written to chunk
+    if (map->occlusion_culler)
     {
-        hashmap_chunks_remove(map->chunks_active, c);
-        chunk_delete(c);
+        for (int i = 0; i < map->occlusion_culler->num_objects; i++)
+        {
+            if (map->occlusion_chunks[i] == c)
+                map->occlusion_chunks[i] = NULL;
+        }
+    }
+
+    hashmap_chunks_remove(map->chunks_active, c);
+    chunk_delete(c);
+
+    // Ideally should rebuild neighbours here, but
+    // this won't update anything because chunks
+    // are not minding neighbours at all, they just
+    // keep separate copy of neighbours' blocks
+}
+
+static Chunk* map_create_chunk(int cx, int cz)
+{
+    Chunk* c = chunk_init(cx, cz);
+    hashmap_chunks_insert(map->chunks_active, c);
+
+    ChunkStats* stats = &map->chunk_stats;
+    uint64_t const now = time_get_ns();
+    int const num_unloads = MIN(stats->unloaded, MAP_RECENT_UNLOADS);
+    for (int i = 0; i < num_unloads; i++)
+    {
+        ChunkUnload* unload = &map->recent_unloads[i];
+        if (unload->cx == cx && unload->cz == cz && 
+            now - unload->time_ns < MAP_RELOAD_WINDOW_NS)
+        {
+            stats->reloaded++;
+            break;
+        }
+    }
+
+    return c;
+}
 
-        // Ideally should rebuild neighbours here, but
-        // this won't update anything because chunks
-        // are not minding neighbours at all, they just
-        // keep separate copy of neighbours' blocks
+// Returns 1 if chunk can be deleted now. Otherwise worker is
+// busy with it or neighbours read its light, and the last of
+// them deletes it in handle_workers()
+static int map_start_unload(Chunk* c)
+{
+    while (true)
+    {
+        ChunkState const state = chunk_get_state(c);
+        if (state == CHUNK_UNLOADING)
+            return 0;
+
+        if (chunk_try_set_state(c, state, CHUNK_UNLOADING))
+            return state != CHUNK_GENERATING && state != CHUNK_MESHING && 
+                   c->num_readers == 0;
     }
 }
 
@@ -96,25 +271,45 @@ static void try_delete_far_chunks(vec3 curr_pos)
 {
     int player_cx = chunked_cam(curr_pos[0]);
     int player_cz = chunked_cam(curr_pos[2]);
+
+    uint64_t const now = time_get_ns();
+    // Prefetched chunks are out of range until player gets there
+    uint64_t const delay = (uint64_t)(MAX(CHUNK_UNLOAD_DELAY, CHUNK_PREFETCH_TIME) * 1e9);
     
-    LinkedList_chunks* chunks_to_delete = list_chunks_create();
+    ChunkArray chunks_to_delete;
+    chunks_to_delete.chunks = frame_arena_alloc(map->chunks_active->size * sizeof(Chunk*));
+    chunks_to_delete.count = 0;
 
     MAP_FOREACH_ACTIVE_CHUNK_BEGIN(c)
     {
-        // Worker thread may be processing this chunk
-        if (!c->is_safe_to_modify)
+        if (chunk_player_dist2(c->x, c->z, player_cx, player_cz) <= CHUNK_UNLOAD_RADIUS2)
+        {
+            c->out_of_range_ns = 0;
+            continue;
+        }
+
+        // Player may come back soon, e.g. when walking along the border
+        if (!c->out_of_range_ns)
+            c->out_of_range_ns = now;
+        if (now - c->out_of_range_ns < delay)
             continue;
 
-        if (chunk_player_dist2(c->x, c->z, player_cx, player_cz) > CHUNK_UNLOAD_RADIUS2)
-            list_chunks_push_front(chunks_to_delete, c);
+        if (map_start_unload(c))
+            chunks_to_delete.chunks[chunks_to_delete.count++] = c;
     }
     MAP_FOREACH_ACTIVE_CHUNK_END()
 
-    LIST_FOREACH_CHUNK_BEGIN(chunks_to_delete, c)
-        map_delete_chunk(c->x, c->z);
-    LIST_FOREACH_CHUNK_END()
+    ARRAY_FOREACH_CHUNK_BEGIN(chunks_to_delete, c)
+        map_delete_chunk(c);
+    ARRAY_FOREACH_CHUNK_END()
+}
 
-    list_chunks_delete(chunks_to_delete);
+// Square around unload circle, chunks that wait for
+// unload outside of it are allocated separately
+static int get_chunk_pool_capacity()
+{
+    int const side = 2 * CHUNK_UNLOAD_RADIUS + 1;
+    return side * side;
 }
 
 void map_init()
@@ -122,7 +317,9 @@ void map_init()
     map = malloc(sizeof(Map));
 
     map->chunks_active    = hashmap_chunks_create(CHUNK_RENDER_RADIUS2 * 1.2f);
-    map->chunks_to_render = list_chunks_create();
+    chunk_pool_init(get_chunk_pool_capacity());
+    map->chunks_to_render.chunks = NULL;
+    map->chunks_to_render.count = 0;
 
     map->VAO_skybox = opengl_create_vao();
     map->VBO_skybox = opengl_create_vbo_cube();
@@ -133,6 +330,11 @@ void map_init()
     opengl_vbo_layout(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 0);
     opengl_vbo_layout(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 3 * sizeof(float));
 
+    // Created before seed is set, which invalidates it
+    map->far_terrain = NULL;
+    if (FAR_TERRAIN_RADIUS > CHUNK_RENDER_RADIUS)
+        map->far_terrain = far_terrain_create(FAR_TERRAIN_RADIUS);
+
     if (db_has_map_info())
     {
         db_load_map_info();
@@ -151,9 +353,67 @@ void map_init()
     
     fprintf(stdout, "Using %d worker(s)\n", map->num_workers);
 
+    map->mesh_buffers = chunk_mesh_buffers_create();
     map->workers = malloc(map->num_workers * sizeof(Worker));
     for (int i = 0; i < map->num_workers; i++) 
         worker_create(&map->workers[i], worker_loop);
+
+    map->occlusion_culler = occlusion_culler_create(1);
+    map->occlusion_chunks_capacity = 256;
+    map->occlusion_chunks = malloc(map->occlusion_chunks_capacity * sizeof(Chunk*));
+
+    map->cave_culler = cave_culler_create();
+
+    map->water_arena = mesh_arena_create(MAP_WATER_ARENA_CAPACITY);
+    map->water_queue_capacity = 256;
+    map->water_queue  = malloc(map->water_queue_capacity * sizeof(WaterDraw));
+    map->water_firsts = malloc(map->water_queue_capacity * sizeof(GLint));
+    map->water_counts = malloc(map->water_queue_capacity * sizeof(GLsizei));
+
+    map->is_headless = 0;
+    map->frame = 0;
+    map->mesh_version = 0;
+    map->num_prefetch_jobs = 0;
+    memset(&map->chunk_stats, 0, sizeof(map->chunk_stats));
+}
+
+void map_init_headless(int seed)
+{
+    map = malloc(sizeof(Map));
+
+    map->chunks_active    = hashmap_chunks_create(CHUNK_RENDER_RADIUS2 * 1.2f);
+    chunk_pool_init(get_chunk_pool_capacity());
+    map->chunks_to_render.chunks = NULL;
+    map->chunks_to_render.count = 0;
+
+    map->VAO_skybox   = 0;
+    map->VBO_skybox   = 0;
+    map->VAO_sun_moon = 0;
+    map->VBO_sun_moon = 0;
+
+    map->workers     = NULL;
+    map->num_workers = 0;
+    map->mesh_buffers = NULL;
+
+    map->occlusion_culler = NULL;
+    map->occlusion_chunks = NULL;
+    map->occlusion_chunks_capacity = 0;
+
+    map->cave_culler = NULL;
+    map->far_terrain = NULL;
+
+    map->water_arena  = NULL;
+    map->water_queue  = NULL;
+    map->water_firsts = NULL;
+    map->water_counts = NULL;
+    map->water_queue_capacity = 0;
+
+    map->seed = seed;
+    map->is_headless = 1;
+    map->frame = 0;
+    map->mesh_version = 0;
+    map->num_prefetch_jobs = 0;
+    memset(&map->chunk_stats, 0, sizeof(map->chunk_stats));
 }
 
 // [0.0 - 1.0)
@@ -328,16 +588,11 @@ void map_render_sky(Camera* cam)
     shader_set_texture_skybox(shader_skybox, "texture_evening", texture_skybox_evening, 1);
     shader_set_texture_skybox(shader_skybox, "texture_night", texture_skybox_night, 2);
     
-    shader_set_float1(shader_skybox, "time", (float)map_get_time());
     shader_set_float1(shader_skybox, "day_to_evn_start", DAY_TO_EVN_START);
     shader_set_float1(shader_skybox, "evn_to_night_start", EVN_TO_NIGHT_START);
     shader_set_float1(shader_skybox, "night_start", NIGHT_START);
     shader_set_float1(shader_skybox, "night_to_day_start", NIGHT_TO_DAY_START);
 
-    vec3 fog_col;
-    map_get_fog_color(&fog_col[0], &fog_col[1], &fog_col[2]);
-    shader_set_float3(shader_skybox, "fog_color", fog_col);
-
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_ALWAYS);
     glBindVertexArray(map->VAO_skybox);
@@ -372,69 +627,250 @@ static float get_shadow_multiplier()
     return res;
 }
 
-void map_render_chunks(Camera* cam, mat4 near_shadowmap_mat, mat4 far_shadowmap_mat)
-{    
-    glUseProgram(shader_block);
+void map_fill_frame_data(FrameData* data)
+{
+    data->time = (float)map_get_time();
+    data->block_light = map_get_blocks_light();
+    int const view_radius = map->far_terrain ? FAR_TERRAIN_RADIUS : CHUNK_RENDER_RADIUS;
+    data->fog_dist = view_radius * CHUNK_SIZE * 0.95f;
+    map_get_fog_color(&data->fog_color[0], &data->fog_color[1], &data->fog_color[2]);
+    map_get_light_dir(data->light_dir);
+
+    data->shadow_multiplier = get_shadow_multiplier();
+    data->shadow_cascades   = SHADOW_CASCADES;
+    data->shadow_blend_dist = 0.05f;
+}
 
-    shader_set_mat4(shader_block, "mvp_matrix", cam->vp_matrix);
-    shader_set_float1(shader_block, "block_light", map_get_blocks_light());
+// Chunk can be skipped only if its box was tested in
+// the previous frame, otherwise the result is unknown
+static int is_occlusion_query_usable(Chunk* c)
+{
+    return OCCLUSION_CULLING && c->occlusion_query_frame == map->frame - 1;
+}
 
-    shader_set_texture_array(shader_block, "texture_sampler", texture_blocks, 0);
+static void begin_chunk_occlusion_test(Chunk* c)
+{
+    // Result may still be not ready, in that case chunk
+    // is rendered. That's the price of never stalling
+    if (is_occlusion_query_usable(c))
+        glBeginConditionalRender(c->occlusion_query, GL_QUERY_NO_WAIT);
+}
+
+static void end_chunk_occlusion_test(Chunk* c)
+{
+    if (is_occlusion_query_usable(c))
+        glEndConditionalRender();
+}
+
+// Render bounding boxes of chunks against depth of terrain rendered
+// in this frame, results are used in the next frame. Chunks that
+// are close to camera are not tested, because their box may be
+// clipped by near plane, they're rendered unconditionally instead
+static void issue_occlusion_queries(Camera* cam)
+{
+    glUseProgram(shader_line);
+    glBindVertexArray(map->VAO_skybox);
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(GL_LEQUAL);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_BLEND);
+
+    float const margin = BLOCK_SIZE;
+
+    ARRAY_FOREACH_CHUNK_BEGIN(map->chunks_to_render, c)
+    {
+        vec3 aabb[2];
+        chunk_get_mesh_aabb(c, aabb);
+
+        if (cam->pos[0] > aabb[0][0] - margin && cam->pos[0] < aabb[1][0] + margin &&
+            cam->pos[1] > aabb[0][1] - margin && cam->pos[1] < aabb[1][1] + margin &&
+            cam->pos[2] > aabb[0][2] - margin && cam->pos[2] < aabb[1][2] + margin)
+        {
+            continue;
+        }
+
+        if (!c->occlusion_query)
+            glGenQueries(1, &c->occlusion_query);
+
+        // Skybox cube has vertices at -1 and 1
+        vec3 center, half_size;
+        glm_aabb_center(aabb, center);
+        glm_vec3_sub(aabb[1], center, half_size);
+
+        mat4 model, mvp_matrix;
+        glm_translate_make(model, center);
+        glm_scale(model, half_size);
+        glm_mat4_mul(cam->vp_matrix, model, mvp_matrix);
+        shader_set_mat4(shader_line, "mvp_matrix", mvp_matrix);
+
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, c->occlusion_query);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+        c->occlusion_query_frame = map->frame;
+    }
+    ARRAY_FOREACH_CHUNK_END()
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+}
+
+// Result of the last query is used only if it's ready, so
+// occluded water is skipped without waiting for the GPU
+static int water_is_occluded(Chunk* c)
+{
+    if (!is_occlusion_query_usable(c))
+        return 0;
+
+    GLuint is_ready = 0;
+    glGetQueryObjectuiv(c->occlusion_query, GL_QUERY_RESULT_AVAILABLE, &is_ready);
+    if (!is_ready)
+        return 0;
+
+    GLuint any_samples = 1;
+    glGetQueryObjectuiv(c->occlusion_query, GL_QUERY_RESULT, &any_samples);
+    return !any_samples;
+}
+
+static int water_draw_compare(const void* a, const void* b)
+{
+    float const dist_a = ((const WaterDraw*)a)->dist2;
+    float const dist_b = ((const WaterDraw*)b)->dist2;
+    return (dist_a < dist_b) - (dist_a > dist_b);
+}
+
+// Transparent queue, the furthest water is drawn first. Chunks
+// are sorted as a whole, that's enough for blending between them
+static void render_water_queue(Camera* cam)
+{
+    int num_draws = 0;
+    ARRAY_FOREACH_CHUNK_BEGIN(map->chunks_to_render, c)
+    {
+        if (!c->water_arena_count || water_is_occluded(c))
+            continue;
+
+        if (num_draws == map->water_queue_capacity)
+        {
+            map->water_queue_capacity *= 2;
+            map->water_queue = realloc(map->water_queue, 
+                map->water_queue_capacity * sizeof(WaterDraw));
+            map->water_firsts = realloc(map->water_firsts, 
+                map->water_queue_capacity * sizeof(GLint));
+            map->water_counts = realloc(map->water_counts, 
+                map->water_queue_capacity * sizeof(GLsizei));
+        }
 
-    shader_set_float3(shader_block, "cam_pos", cam->pos);
-    shader_set_float1(shader_block, "fog_dist", CHUNK_RENDER_RADIUS * CHUNK_SIZE * 0.95f);
+        float const dx = (c->x + 0.5f) * CHUNK_SIZE - cam->pos[0];
+        float const dz = (c->z + 0.5f) * CHUNK_SIZE - cam->pos[2];
 
-    float r, g, b;
-    map_get_fog_color(&r, &g, &b);
-    shader_set_float3(shader_block, "fog_color", (vec3){r, g, b});
+        WaterDraw* draw = &map->water_queue[num_draws++];
+        draw->dist2 = dx * dx + dz * dz;
+        draw->first = c->water_arena_first;
+        draw->count = c->water_arena_count;
+    }
+    ARRAY_FOREACH_CHUNK_END()
+
+    if (num_draws == 0)
+        return;
+
+    qsort(map->water_queue, num_draws, sizeof(WaterDraw), water_draw_compare);
+
+    int num_ranges = 0;
+    for (int i = 0; i < num_draws; i++)
+    {
+        WaterDraw* draw = &map->water_queue[i];
+        if (num_ranges > 0 && 
+            map->water_firsts[num_ranges - 1] + map->water_counts[num_ranges - 1] == draw->first)
+        {
+            map->water_counts[num_ranges - 1] += draw->count;
+            continue;
+        }
 
-    shader_set_mat4(shader_block, "u_near_shadowmap_mat", near_shadowmap_mat);
-    shader_set_mat4(shader_block, "u_far_shadowmap_mat", far_shadowmap_mat);
+        map->water_firsts[num_ranges] = draw->first;
+        map->water_counts[num_ranges] = draw->count;
+        num_ranges++;
+    }
 
-    shader_set_texture_2d(shader_block, "u_near_shadowmap", 
-        g_window->fb->gbuf_shadow_near_map, 1);
-    shader_set_texture_2d(shader_block, "u_far_shadowmap", 
-        g_window->fb->gbuf_shadow_far_map, 2);
+    glBindVertexArray(map->water_arena->VAO);
+    glMultiDrawArrays(GL_TRIANGLES, map->water_firsts, map->water_counts, num_ranges);
+}
 
-    vec3 light_dir;
-    map_get_light_dir(light_dir);
-    shader_set_float3(shader_block, "u_light_dir", light_dir);
+// Far terrain is drawn only where chunk mesh isn't
+static int chunk_has_mesh(int cx, int cz)
+{
+    Chunk* c = map_get_chunk(cx, cz);
+    return c && c->has_mesh;
+}
 
-    shader_set_float1(shader_block, "u_near_shadow_dist", 2.0f);
-    shader_set_float1(shader_block, "u_shadow_blend_dist", 0.1f);
+void map_render_chunks(Camera* cam)
+{    
+    map->frame++;
 
-    shader_set_float3(shader_block, "u_player_pos", cam->pos);
+    glUseProgram(shader_block);
 
-    shader_set_float1(shader_block, "u_shadow_multiplier", get_shadow_multiplier());
+    shader_set_texture_array(shader_block, "texture_sampler", texture_blocks, 0);
+
+    shader_set_texture_array(shader_block, "u_shadowmaps", 
+        g_window->fb->gbuf_shadow_maps, 1);
 
     // Everything except water doesn't need blending
     glDepthFunc(GL_LESS);
     glDisable(GL_BLEND);
-    LIST_FOREACH_CHUNK_BEGIN(map->chunks_to_render, c)
+    ARRAY_FOREACH_CHUNK_BEGIN(map->chunks_to_render, c)
     {
+        begin_chunk_occlusion_test(c);
         glBindVertexArray(c->VAO_land);
         glDrawArrays(GL_TRIANGLES, 0, c->vertex_land_count);
+        end_chunk_occlusion_test(c);
+    }
+    ARRAY_FOREACH_CHUNK_END()
+
+    if (map->far_terrain)
+    {
+        far_terrain_render(map->far_terrain, chunked_cam(cam->pos[0]), 
+            chunked_cam(cam->pos[2]), cam->frustum_planes, chunk_has_mesh);
     }
-    LIST_FOREACH_CHUNK_END()
 
     // Water does need blending to be transparent, also
     // to see water from underneath we have to disable face culling
     glDepthMask(GL_FALSE);
     glEnable(GL_BLEND);
     glDisable(GL_CULL_FACE);
-    LIST_FOREACH_CHUNK_BEGIN(map->chunks_to_render, c)
-    {
-        glBindVertexArray(c->VAO_water);
-        glDrawArrays(GL_TRIANGLES, 0, c->vertex_water_count);
-    }
-    LIST_FOREACH_CHUNK_END()
+    render_water_queue(cam);
     glDepthMask(GL_TRUE);
     glEnable(GL_CULL_FACE);
 
-    list_chunks_clear(map->chunks_to_render);
+    // Depth buffer has only opaque terrain, so
+    // chunks behind water are still rendered
+    if (OCCLUSION_CULLING)
+        issue_occlusion_queries(cam);
 }
 
-void map_render_chunks_raw(vec4 frustum_planes[6])
+int map_get_mesh_version()
+{
+    return map->mesh_version;
+}
+
+int map_meshes_changed_since(int version, vec4 frustum_planes[6])
+{
+    if (map->mesh_version - version >= MAP_MESH_CHANGES)
+        return 1;
+
+    for (int v = version + 1; v <= map->mesh_version; v++)
+    {
+        MeshChange* change = &map->mesh_changes[v % MAP_MESH_CHANGES];
+        if (chunk_is_visible(change->cx, change->cz, frustum_planes))
+            return 1;
+    }
+    return 0;
+}
+
+void map_render_shadow_casters(vec4 frustum_planes[6], int alpha_tested)
 {
     glEnable(GL_DEPTH_TEST);
     glDepthMask(GL_TRUE);
@@ -442,11 +878,18 @@ void map_render_chunks_raw(vec4 frustum_planes[6])
     glDisable(GL_BLEND);
     MAP_FOREACH_ACTIVE_CHUNK_BEGIN(c)
     {
-        //if (c->is_generated) 
-        if (c->is_generated && chunk_is_visible(c->x, c->z, frustum_planes))
+        if (c->has_mesh && chunk_mesh_is_visible(c, frustum_planes))
         {
-            glBindVertexArray(c->VAO_land);
-            glDrawArrays(GL_TRIANGLES, 0, c->vertex_land_count);
+            if (alpha_tested && c->vertex_shadow_alpha_count)
+            {
+                glBindVertexArray(c->VAO_shadow_alpha);
+                glDrawArrays(GL_TRIANGLES, 0, c->vertex_shadow_alpha_count);
+            }
+            else if (!alpha_tested && c->vertex_shadow_count)
+            {
+                glBindVertexArray(c->VAO_shadow);
+                glDrawArrays(GL_TRIANGLES, 0, c->vertex_shadow_count);
+            }
         }
     }
     MAP_FOREACH_ACTIVE_CHUNK_END()
@@ -455,21 +898,123 @@ void map_render_chunks_raw(vec4 frustum_planes[6])
 unsigned char map_get_block(int bx, int by, int bz)
 {
     Chunk* c = map_get_chunk(chunked_block(bx), chunked_block(bz));
-    if (!c || !c->is_generated) 
+    if (!c || !chunk_has_blocks(c)) 
         return BLOCK_AIR;
 
     return c->blocks[XYZ(to_chunk_coord(bx), by, to_chunk_coord(bz))];
 }
 
+void map_collision_grid_fill(MapCollisionGrid* grid, ivec3 min, ivec3 max)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        grid->min[i] = min[i];
+        grid->size[i] = max[i] - min[i] + 1;
+    }
+    memset(grid->cells, 0, grid->size[0] * grid->size[1] * grid->size[2]);
+
+    int const min_y = MAX(min[1], 0);
+    int const max_y = MIN(max[1], CHUNK_HEIGHT - 1);
+
+    // Every column is in one chunk, so chunk is looked up once per column
+    for (int x = 0; x < grid->size[0]; x++)
+    for (int z = 0; z < grid->size[2]; z++)
+    {
+        int const bx = min[0] + x;
+        int const bz = min[2] + z;
+
+        Chunk* c = map_get_chunk(chunked_block(bx), chunked_block(bz));
+        if (!c || !chunk_has_blocks(c)) 
+            continue;
+
+        int const cx = to_chunk_coord(bx);
+        int const cz = to_chunk_coord(bz);
+
+        for (int by = min_y; by <= max_y; by++)
+        {
+            unsigned char block = c->blocks[XYZ(cx, by, cz)];
+            int const y = by - min[1];
+            grid->cells[(x * grid->size[1] + y) * grid->size[2] + z] = 
+                block_is_solid(block) && !block_is_plant(block);
+        }
+    }
+}
+
+int map_raycast(vec3 origin, vec3 dir, float max_dist, MapRaycastHit* hit)
+{
+    // Everything is done in blocks, not in world units
+    vec3 pos;
+    glm_vec3_divs(origin, BLOCK_SIZE, pos);
+    float const max_t = max_dist / BLOCK_SIZE;
+
+    ivec3 cell, step;
+    vec3 t_max, t_delta;
+    for (int i = 0; i < 3; i++)
+    {
+        cell[i] = (int)floorf(pos[i]);
+        step[i] = (dir[i] > 0.0f) ? 1 : -1;
+
+        if (dir[i] == 0.0f)
+        {
+            t_max[i] = FLT_MAX;
+            t_delta[i] = FLT_MAX;
+            continue;
+        }
+
+        // Distance along the ray to the first boundary of cell and between boundaries
+        float const boundary = (dir[i] > 0.0f) ? cell[i] + 1.0f : (float)cell[i];
+        t_max[i] = (boundary - pos[i]) / dir[i];
+        t_delta[i] = fabsf(1.0f / dir[i]);
+    }
+
+    ivec3 normal = { 0, 0, 0 };
+    float t = 0.0f;
+
+    while (t <= max_t)
+    {
+        if (cell[1] >= 0 && cell[1] < CHUNK_HEIGHT)
+        {
+            unsigned char block = map_get_block(cell[0], cell[1], cell[2]);
+
+            // Plants have smaller hitbox than cell, ray may miss it
+            if (block_is_solid(block) && (!block_is_plant(block) || 
+                block_ray_intersection(origin, dir, cell[0], cell[1], cell[2], block)))
+            {
+                my_glm_ivec3_set(hit->block, cell[0], cell[1], cell[2]);
+                my_glm_ivec3_set(hit->normal, normal[0], normal[1], normal[2]);
+                hit->type = block;
+                hit->dist = t * BLOCK_SIZE;
+                return 1;
+            }
+        }
+
+        // Step over the closest cell boundary
+        int axis = (t_max[0] < t_max[1]) ? 0 : 1;
+        if (t_max[2] < t_max[axis])
+            axis = 2;
+
+        t = t_max[axis];
+        t_max[axis] += t_delta[axis];
+        cell[axis] += step[axis];
+
+        my_glm_ivec3_set(normal, 0, 0, 0);
+        normal[axis] = -step[axis];
+    }
+
+    return 0;
+}
+
 static void set_block_helper(int cx, int cz, int bx, int by, int bz, int block)
 {
     db_insert_block(cx, cz, bx, by, bz, block);
     
+    // Chunk that is still generated takes block from database
     Chunk* c = map_get_chunk(cx, cz);
-    if (c)
+    if (c && chunk_has_blocks(c))
     {
         c->blocks[XYZ(bx, by, bz)] = block;
         c->is_dirty = 1;
+        chunk_add_light_edit(c, XYZ(bx, by, bz));
     }
 }
 
@@ -534,6 +1079,24 @@ void map_set_block(int bx, int by, int bz, unsigned char block)
     set_block(c, x, by, z, block);
 }
 
+// Cells of merged blocks have to fit chunk width
+static int get_chunk_lod(int cx, int cz, int player_cx, int player_cz)
+{
+    int const dist2 = chunk_player_dist2(cx, cz, player_cx, player_cz);
+
+    int lod = 0;
+    if (LOD_DISTANCE_1 > 0 && dist2 > LOD_DISTANCE_1 * LOD_DISTANCE_1)
+        lod = 1;
+    if (LOD_DISTANCE_2 > 0 && dist2 > LOD_DISTANCE_2 * LOD_DISTANCE_2)
+        lod = 2;
+
+    lod = MIN(lod, CHUNK_MAX_LOD);
+    while (lod > 0 && CHUNK_WIDTH % (1 << lod))
+        lod--;
+
+    return lod;
+}
+
 static int find_chunk_for_worker(Camera* cam, int* best_x, int* best_z)
 {
     int player_cx = chunked_cam(cam->pos[0]);
@@ -551,8 +1114,19 @@ static int find_chunk_for_worker(Camera* cam, int* best_x, int* best_z)
         
         Chunk* c = map_get_chunk(x, z);
 
+        // Light of chunk can't be written while some worker uses it,
+        // unloaded chunk is created again once it's deleted
+        if (c && (chunk_is_busy(c) || chunk_get_state(c) == CHUNK_UNLOADING || 
+                  c->num_readers > 0))
+            continue;
+
+        // Meshed chunk that crossed LOD ring is remeshed
+        // with the same priority as a new one
+        // Prefetched chunk without mesh is meshed like a new one
         int not_dirty  = c ? !c->is_dirty : 1;
-        if (c && not_dirty)
+        int lod_changed = c && c->has_mesh &&
+                          c->mesh_lod != get_chunk_lod(x, z, player_cx, player_cz);
+        if (c && not_dirty && !lod_changed && c->has_mesh)
             continue;
         int not_visible = !chunk_is_visible(x, z, cam->frustum_planes);
         int dist = chunk_player_dist2(x, z, player_cx, player_cz);
@@ -578,7 +1152,135 @@ static int find_chunk_for_worker(Camera* cam, int* best_x, int* best_z)
     return false;
 }
 
-static void handle_workers(Camera* cam)
+// At least one worker is left for chunks around player
+static int get_prefetch_budget()
+{
+    return MIN(CHUNK_PREFETCH_WORKERS, map->num_workers - 1);
+}
+
+// Player's position is extrapolated from its velocity by steps of one 
+// chunk, but not further than load radius. Chunks that get into load
+// radius around the next step are candidates, the earliest ones in
+// front of camera are the first. Chunks already in load radius are
+// left for find_chunk_for_worker()
+static int find_chunk_for_prefetch(Camera* cam, vec3 velocity, int* best_x, int* best_z)
+{
+    float const speed = glm_vec2_norm((vec2){ velocity[0], velocity[2] });
+    float const path_len = MIN(speed * CHUNK_PREFETCH_TIME, CHUNK_LOAD_RADIUS * CHUNK_SIZE);
+    int const num_steps = (int)(path_len / CHUNK_SIZE);
+    if (num_steps < 1)
+        return false;
+
+    int const player_cx = chunked_cam(cam->pos[0]);
+    int const player_cz = chunked_cam(cam->pos[2]);
+
+    int best_score = INT_MAX;
+    int best_cx = 0, best_cz = 0;
+    int found = 0;
+
+    int prev_cx = player_cx, prev_cz = player_cz;
+    for (int step = 1; step <= num_steps; step++)
+    {
+        // Later steps can't have better score
+        if (found && best_score < (step << 16))
+            break;
+
+        float const t = step * CHUNK_SIZE / speed;
+        int const step_cx = chunked_cam(cam->pos[0] + velocity[0] * t);
+        int const step_cz = chunked_cam(cam->pos[2] + velocity[2] * t);
+
+        for (int x = step_cx - CHUNK_LOAD_RADIUS; x <= step_cx + CHUNK_LOAD_RADIUS; x++)
+        for (int z = step_cz - CHUNK_LOAD_RADIUS; z <= step_cz + CHUNK_LOAD_RADIUS; z++)
+        {
+            if (chunk_player_dist2(x, z, step_cx, step_cz) > CHUNK_LOAD_RADIUS2 ||
+                chunk_player_dist2(x, z, prev_cx, prev_cz) <= CHUNK_LOAD_RADIUS2)
+                continue;
+
+            if (map_get_chunk(x, z))
+                continue;
+
+            // Chunks behind camera won't pop in, even if player gets there
+            int behind = (x - player_cx) * cam->front[0] + (z - player_cz) * cam->front[2] < 0.0f;
+            int dist2 = chunk_player_dist2(x, z, player_cx, player_cz);
+
+            int curr_score = (behind << 24) + (step << 16) + dist2;
+            if (curr_score < best_score)
+            {
+                best_cx = x;
+                best_cz = z;
+                best_score = curr_score;
+                found = 1;
+            }
+        }
+
+        prev_cx = step_cx;
+        prev_cz = step_cz;
+    }
+
+    if (found)
+    {
+        *best_x = best_cx;
+        *best_z = best_cz;
+        return true;
+    }
+    return false;
+}
+
+// Job reads light of neighbours that no other worker writes,
+// they are pinned until it's done
+static void prepare_light_job(WorkerData* worker, Chunk* c)
+{
+    for (int dx = -1; dx <= 1; dx++)
+    for (int dz = -1; dz <= 1; dz++)
+    {
+        Chunk* n = (dx || dz) ? map_get_chunk(c->x + dx, c->z + dz) : NULL;
+        if (n && chunk_get_state(n) != CHUNK_GENERATED && chunk_get_state(n) != CHUNK_READY)
+            n = NULL;
+        if (n)
+            n->num_readers++;
+        worker->neighs[LIGHT_NEIGH(dx, dz)] = n;
+    }
+
+    if (worker->light_edits_capacity < c->num_light_edits)
+    {
+        worker->light_edits_capacity = c->light_edits_capacity;
+        worker->light_edits = realloc(worker->light_edits, 
+                                      worker->light_edits_capacity * sizeof(int));
+    }
+    memcpy(worker->light_edits, c->light_edits, c->num_light_edits * sizeof(int));
+    worker->num_light_edits = c->num_light_edits;
+    c->num_light_edits = 0;
+}
+
+// Neighbours whose halo doesn't match new light of chunk are remeshed
+static void finish_light_job(WorkerData* worker)
+{
+    for (int i = 0; i < 9; i++)
+    {
+        Chunk* n = worker->neighs[i];
+        if (!n)
+            continue;
+
+        n->num_readers--;
+        worker->neighs[i] = NULL;
+
+        // The last reader of unloaded chunk deletes it
+        if (chunk_get_state(n) == CHUNK_UNLOADING)
+        {
+            if (n->num_readers == 0)
+                map_delete_chunk(n);
+            continue;
+        }
+
+        if (worker->outdated_neighs & (1 << i))
+        {
+            light_add_border_edits(worker->chunk, n, i / 3 - 1, i % 3 - 1);
+            n->is_dirty = 1;
+        }
+    }
+}
+
+static void handle_workers(Camera* cam, vec3 velocity)
 {
     for (int i = 0; i < map->num_workers; i++)
     {
@@ -596,15 +1298,43 @@ static void handle_workers(Camera* cam)
             worker->state = WORKER_IDLE;
 
             Chunk* c = worker->chunk;
-            chunk_upload_mesh_to_gpu(c);
-
-            c->is_safe_to_modify = 1;
+            if (worker->generate_terrain)
+                map->chunk_stats.generated++;
+            if (worker->is_prefetch)
+                map->num_prefetch_jobs--;
+
+            // Prefetched terrain waits for its mesh in CHUNK_GENERATED
+            ChunkState const job_state  = worker->generate_mesh ? CHUNK_MESHING : CHUNK_GENERATING;
+            ChunkState const idle_state = worker->generate_mesh ? CHUNK_READY   : CHUNK_GENERATED;
+            if (chunk_try_set_state(c, job_state, idle_state))
+            {
+                if (worker->generate_mesh)
+                {
+                    PROFILER_ZONE_BEGIN("chunk_upload_mesh_to_gpu");
+                    chunk_upload_mesh_to_gpu(c, map->water_arena);
+                    record_mesh_change(c);
+                    PROFILER_ZONE_END();
+                }
+                finish_light_job(worker);
+            }
+            else
+            {
+                // Chunk was unloaded during the job, mesh is thrown
+                // away. Chunks in work are never pinned as neighbours
+                finish_light_job(worker);
+                map_delete_chunk(c);
+            }
+            worker->chunk = NULL;
         }
 
         if (worker->state == WORKER_IDLE)
         {
+            // Prefetch keeps its workers ahead of player, others
+            // load chunks around player
             int best_cx, best_cz;
-            int found = find_chunk_for_worker(cam, &best_cx, &best_cz);
+            int is_prefetch = map->num_prefetch_jobs < get_prefetch_budget() &&
+                              find_chunk_for_prefetch(cam, velocity, &best_cx, &best_cz);
+            int found = is_prefetch || find_chunk_for_worker(cam, &best_cx, &best_cz);
             if (!found)
             {
                 mtx_unlock(&worker->state_mtx);
@@ -612,20 +1342,31 @@ static void handle_workers(Camera* cam)
             }
             
             Chunk* c = map_get_chunk(best_cx, best_cz);
+            int const lod = get_chunk_lod(best_cx, best_cz, 
+                chunked_cam(cam->pos[0]), chunked_cam(cam->pos[2]));
             if (c)
             {
                 c->is_dirty = 0;
                 worker->generate_terrain = 0;
+                worker->generate_mesh = 1;
+                chunk_set_state(c, CHUNK_MESHING);
             }
             else
             {
-                c = chunk_init(best_cx, best_cz);
-                hashmap_chunks_insert(map->chunks_active, c);
+                c = map_create_chunk(best_cx, best_cz);
                 worker->generate_terrain = 1;
+                worker->generate_mesh = !is_prefetch || CHUNK_PREFETCH_MESH;
+                chunk_set_state(c, CHUNK_GENERATING);
             }
+
+            worker->is_prefetch = is_prefetch;
+            if (is_prefetch)
+                map->num_prefetch_jobs++;
             
-            c->is_safe_to_modify = 0;
+            c->lod = lod;
             worker->chunk = c;
+            if (worker->generate_mesh)
+                prepare_light_job(worker, c);
             worker->state = WORKER_BUSY;
 
             mtx_unlock(&worker->state_mtx);
@@ -639,12 +1380,20 @@ static void handle_workers(Camera* cam)
 
 static void load_chunk(int cx, int cz)
 {
-    Chunk* c = chunk_init(cx, cz);
+    Chunk* c = map_create_chunk(cx, cz);
     chunk_generate_terrain(c);
-    chunk_generate_mesh(c);
-    chunk_upload_mesh_to_gpu(c);
+    map->chunk_stats.generated++;
 
-    hashmap_chunks_insert(map->chunks_active, c);
+    // There's no GPU to upload mesh to, blocks are enough
+    if (map->is_headless)
+        chunk_set_state(c, CHUNK_GENERATED);
+    else
+    {
+        chunk_generate_mesh(c, map->mesh_buffers);
+        chunk_upload_mesh_to_gpu(c, map->water_arena);
+        record_mesh_change(c);
+        chunk_set_state(c, CHUNK_READY);
+    }
 }
 
 void map_force_chunks_near_player(vec3 curr_pos)
@@ -665,28 +1414,159 @@ void map_force_chunks_near_player(vec3 curr_pos)
     }
 }
 
+// Send opaque parts and boxes of all visible chunks to occlusion
+// culler. It works in parallel with handle_workers(), which may
+// upload new meshes, so everything is copied here
+static void start_occlusion_culling(Camera* cam)
+{
+    if (!CPU_OCCLUSION_CULLING || !map->occlusion_culler)
+        return;
+
+    OcclusionCuller* oc = map->occlusion_culler;
+    occlusion_culler_reset(oc, cam->vp_matrix);
+
+    float const margin = BLOCK_SIZE;
+
+    MAP_FOREACH_ACTIVE_CHUNK_BEGIN(c)
+    {
+        c->is_occluded = 0;
+
+        if (!c->has_mesh || !chunk_mesh_is_visible(c, cam->frustum_planes))
+            continue;
+
+        vec3 boxes[CHUNK_MAX_SLICES][2];
+        int num_boxes = chunk_get_occluders(c, boxes);
+        for (int j = 0; j < num_boxes; j++)
+        {
+            // Camera may end up inside of a block for a moment,
+            // such occluder would hide everything
+            if (cam->pos[0] > boxes[j][0][0] - margin && cam->pos[0] < boxes[j][1][0] + margin &&
+                cam->pos[1] > boxes[j][0][1] - margin && cam->pos[1] < boxes[j][1][1] + margin &&
+                cam->pos[2] > boxes[j][0][2] - margin && cam->pos[2] < boxes[j][1][2] + margin)
+            {
+                continue;
+            }
+            occlusion_culler_add_occluder(oc, boxes[j]);
+        }
+
+        vec3 aabb[2];
+        chunk_get_mesh_aabb(c, aabb);
+        int id = occlusion_culler_add_object(oc, aabb);
+
+        if (id == map->occlusion_chunks_capacity)
+        {
+            map->occlusion_chunks_capacity *= 2;
+            map->occlusion_chunks = realloc(map->occlusion_chunks, 
+                map->occlusion_chunks_capacity * sizeof(Chunk*));
+        }
+        map->occlusion_chunks[id] = c;
+    }
+    MAP_FOREACH_ACTIVE_CHUNK_END()
+
+    occlusion_culler_start(oc);
+}
+
+static void finish_occlusion_culling()
+{
+    if (!CPU_OCCLUSION_CULLING || !map->occlusion_culler)
+        return;
+
+    OcclusionCuller* oc = map->occlusion_culler;
+    occlusion_culler_wait(oc);
+
+    for (int i = 0; i < oc->num_objects; i++)
+    {
+        if (map->occlusion_chunks[i])
+            map->occlusion_chunks[i]->is_occluded = !occlusion_culler_is_visible(oc, i);
+    }
+}
+
+// Runs after handle_workers(), so chunks meshed
+// in this frame are tested with their new slices
+static void cave_culling(Camera* cam)
+{
+    if (CAVE_CULLING && map->cave_culler && cave_culler_run(map->cave_culler, 
+        cam->pos, cam->frustum_planes, CHUNK_UNLOAD_RADIUS, map_get_chunk))
+    {
+        return;
+    }
+
+    MAP_FOREACH_ACTIVE_CHUNK_BEGIN(c)
+        c->is_cave_visible = 1;
+    MAP_FOREACH_ACTIVE_CHUNK_END()
+}
+
 static void add_chunks_to_render_list(Camera* cam)
 {
+    cave_culling(cam);
+    finish_occlusion_culling();
+
+    ChunkArray* list = &map->chunks_to_render;
+    list->chunks = frame_arena_alloc(map->chunks_active->size * sizeof(Chunk*));
+    list->count = 0;
+
+    // Chunks that got their first mesh during this frame
+    // weren't tested, they're never marked as occluded
     MAP_FOREACH_ACTIVE_CHUNK_BEGIN(c)
     {
-        if (c->is_generated && chunk_is_visible(c->x, c->z, cam->frustum_planes))
-            list_chunks_push_front(map->chunks_to_render, c);
+        if (c->has_mesh && c->is_cave_visible && !c->is_occluded && 
+            chunk_mesh_is_visible(c, cam->frustum_planes))
+            list->chunks[list->count++] = c;
     }
     MAP_FOREACH_ACTIVE_CHUNK_END()
 }
 
-void map_update(Camera* cam)
+void map_update_chunks(Camera* cam, vec3 velocity)
 {
+    PROFILER_ZONE_BEGIN("map_update_chunks");
+
+    PROFILER_ZONE_BEGIN("try_delete_far_chunks");
     try_delete_far_chunks(cam->pos);
-    handle_workers(cam);
+    PROFILER_ZONE_END();
+
+    PROFILER_ZONE_BEGIN("handle_workers");
+    handle_workers(cam, velocity);
+    PROFILER_ZONE_END();
+
+    PROFILER_ZONE_BEGIN("map_force_chunks_near_player");
     map_force_chunks_near_player(cam->pos);
+    PROFILER_ZONE_END();
+
+    if (map->far_terrain)
+    {
+        PROFILER_ZONE_BEGIN("far_terrain_update");
+        far_terrain_update(map->far_terrain, chunked_cam(cam->pos[0]), chunked_cam(cam->pos[2]));
+        PROFILER_ZONE_END();
+    }
+
+    PROFILER_ZONE_END();
+}
+
+void map_start_culling(Camera* cam)
+{
+    PROFILER_ZONE_BEGIN("start_occlusion_culling");
+    start_occlusion_culling(cam);
+    PROFILER_ZONE_END();
+}
+
+void map_update(Camera* cam)
+{
+    PROFILER_ZONE_BEGIN("map_update");
+
+    PROFILER_ZONE_BEGIN("add_chunks_to_render_list");
     add_chunks_to_render_list(cam);
+    PROFILER_ZONE_END();
+
+    PROFILER_ZONE_END();
 }
 
 void map_set_seed(int new_seed)
 {
     printf("Using seed: %d\n", new_seed);
     map->seed = new_seed;
+
+    if (map->far_terrain)
+        far_terrain_invalidate(map->far_terrain);
 }
 
 void map_set_time(double new_time)
@@ -754,22 +1634,52 @@ void map_free()
     for (int i = 0; i < map->num_workers; i++)
         worker_destroy(&map->workers[i]);
     free(map->workers);
-
-    // Chunk hashmaps and lists
-    LinkedList_chunks* to_delete = list_chunks_create();
+    if (map->mesh_buffers)
+        chunk_mesh_buffers_destroy(map->mesh_buffers);
+
+    if (map->occlusion_culler)
+        occlusion_culler_destroy(map->occlusion_culler);
+    free(map->occlusion_chunks);
+
+    if (map->cave_culler)
+        cave_culler_destroy(map->cave_culler);
+    if (map->far_terrain)
+        far_terrain_destroy(map->far_terrain);
+
+    // Chunk hashmap
+    ChunkArray to_delete;
+    to_delete.chunks = malloc(map->chunks_active->size * sizeof(Chunk*));
+    to_delete.count = 0;
     MAP_FOREACH_ACTIVE_CHUNK_BEGIN(c)
-        list_chunks_push_back(to_delete, c);
+        to_delete.chunks[to_delete.count++] = c;
     MAP_FOREACH_ACTIVE_CHUNK_END()
 
-    while (to_delete->size)
-    {
-        Chunk* c = list_chunks_pop_front(to_delete);
+    ARRAY_FOREACH_CHUNK_BEGIN(to_delete, c)
         chunk_delete(c);
-    }
+    ARRAY_FOREACH_CHUNK_END()
 
     hashmap_chunks_delete(map->chunks_active);
-    list_chunks_delete(map->chunks_to_render);
-    list_chunks_delete(to_delete);
+    free(to_delete.chunks);
+
+    ChunkPoolStats stats;
+    chunk_pool_get_stats(&stats);
+    fprintf(stdout, "Chunk pool: peak %d of %d slots, %d chunks outside of slab, "
+            "%d block and light buffers\n", stats.peak_used, stats.capacity, 
+            stats.num_free_overflow, stats.num_buffers);
+    chunk_pool_free();
+
+    ChunkStats* chunk_stats = &map->chunk_stats;
+    fprintf(stdout, "Chunks: %d generated, %d unloaded, %d of them without mesh, "
+            "%d generated again within %d s\n", chunk_stats->generated, 
+            chunk_stats->unloaded, chunk_stats->unloaded_without_mesh, 
+            chunk_stats->reloaded, (int)(MAP_RELOAD_WINDOW_NS / 1000000000ull));
+
+    // Chunks have returned their water already
+    if (map->water_arena)
+        mesh_arena_destroy(map->water_arena);
+    free(map->water_queue);
+    free(map->water_firsts);
+    free(map->water_counts);
 
     free(map);
     map = NULL;
@@ -3,23 +3,82 @@
 
 #include <glad/glad.h>
 
+#include <shader.h>
 #include <linked_list.h>
 #include <hashmap.h>
 #include <map/chunk.h>
 #include <camera/camera.h>
 #include <player/player.h>
 
+typedef struct
+{
+    // World coordinates of hit block
+    ivec3 block;
+
+    // Normal of face that was hit, all zeros if
+    // ray starts inside of solid block
+    ivec3 normal;
+
+    unsigned char type;
+
+    // Distance from origin to hit point
+    float dist;
+}
+MapRaycastHit;
+
+// Which blocks inside of box player can collide with, read
+// once so collision tests don't look up chunks for every block
+typedef struct
+{
+    // World coordinates of first cell and size of box in blocks
+    ivec3 min;
+    ivec3 size;
+
+    // 1 if block collides, x is outermost and z innermost
+    unsigned char* cells;
+}
+MapCollisionGrid;
+
 void map_init();
 
+// Init map without OpenGL objects and worker threads, e.g. 
+// for benchmarks. Chunks are loaded only by 
+// map_force_chunks_near_player() and don't have meshes
+void map_init_headless(int seed);
+
+// Loads, unloads and meshes chunks around camera, runs
+// at MAP_UPDATE_RATE and not every frame. Chunks on the
+// way are prefetched using velocity of player in world
+// units per second
+void map_update_chunks(Camera* cam, vec3 velocity);
+
+// Starts occlusion culling on its own thread, every frame
+// before map_update_chunks(), so they run at the same time
+void map_start_culling(Camera* cam);
+
+// Finds chunks to render from camera, every frame.
+// Waits for culling started by map_start_culling()
 void map_update(Camera* cam);
 
 void map_render_sun_moon(Camera* cam);
 
 void map_render_sky(Camera* cam);
 
-void map_render_chunks(Camera* cam, mat4 near_shadowmap_mat, mat4 far_shadowmap_mat);
+void map_render_chunks(Camera* cam);
+
+// Depth-only meshes of chunks for shadow pass. Opaque ones are just
+// positions, alpha tested ones have full vertices and need texture
+void map_render_shadow_casters(vec4 frustum_planes[6], int alpha_tested);
 
-void map_render_chunks_raw(vec4 frustum_planes[6]);
+// Increased with every chunk mesh upload or removal
+int map_get_mesh_version();
+
+// Whether chunk meshes inside frustum were uploaded
+// or removed after map_get_mesh_version() was version
+int map_meshes_changed_since(int version, vec4 frustum_planes[6]);
+
+// Time, light and fog parts of per-frame shader data
+void map_fill_frame_data(FrameData* data);
 
 void map_force_chunks_near_player(vec3 curr_pos);
 
@@ -31,6 +90,31 @@ void map_set_time(double new_time);
 
 unsigned char map_get_block(int x, int y, int z);
 
+// Fills grid with blocks from min to max inclusive, blocks
+// outside of map and unloaded chunks don't collide. Cells are
+// owned by caller and must fit whole box
+void map_collision_grid_fill(MapCollisionGrid* grid, ivec3 min, ivec3 max);
+
+static inline int map_collision_grid_get(MapCollisionGrid* grid, int x, int y, int z)
+{
+    x -= grid->min[0];
+    y -= grid->min[1];
+    z -= grid->min[2];
+
+    if (x < 0 || x >= grid->size[0] || y < 0 || y >= grid->size[1] || 
+        z < 0 || z >= grid->size[2])
+    {
+        return 0;
+    }
+
+    return grid->cells[(x * grid->size[1] + y) * grid->size[2] + z];
+}
+
+// First solid block along ray, only blocks the ray goes through
+// are visited (Amanatides & Woo). Direction has to be normalized,
+// returns 0 if nothing was hit within max_dist
+int map_raycast(vec3 origin, vec3 dir, float max_dist, MapRaycastHit* hit);
+
 double map_get_time();
 
 int map_get_seed();
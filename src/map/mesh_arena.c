@@ -0,0 +1,155 @@
+#include <map/mesh_arena.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static void set_vertex_layout()
+{
+    opengl_vbo_layout(0, 3, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 0);
+    opengl_vbo_layout(1, 2, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 3 * sizeof(float));
+    opengl_vbo_layout(2, 1, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 5 * sizeof(float));
+    opengl_vbo_layout(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float));
+    opengl_vbo_layout(4, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float) + 1);
+    opengl_vbo_layout(5, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float) + 2);
+}
+
+static GLuint create_buffer(int capacity)
+{
+    GLuint VBO;
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
+    return VBO;
+}
+
+// Put range back, merging it with neighbours
+static void insert_free_range(MeshArena* ma, int first, int count)
+{
+    int i = 0;
+    while (i < ma->num_free_ranges && ma->free_ranges[i].first < first)
+        i++;
+
+    MeshArenaRange* prev = (i > 0) ? &ma->free_ranges[i - 1] : NULL;
+    MeshArenaRange* next = (i < ma->num_free_ranges) ? &ma->free_ranges[i] : NULL;
+
+    int const touches_prev = prev && prev->first + prev->count == first;
+    int const touches_next = next && first + count == next->first;
+
+    if (touches_prev && touches_next)
+    {
+        prev->count += count + next->count;
+        memmove(next, next + 1, (ma->num_free_ranges - i - 1) * sizeof(MeshArenaRange));
+        ma->num_free_ranges--;
+    }
+    else if (touches_prev)
+    {
+        prev->count += count;
+    }
+    else if (touches_next)
+    {
+        next->first = first;
+        next->count += count;
+    }
+    else
+    {
+        if (ma->num_free_ranges == ma->free_ranges_capacity)
+        {
+            ma->free_ranges_capacity *= 2;
+            ma->free_ranges = realloc(ma->free_ranges, 
+                ma->free_ranges_capacity * sizeof(MeshArenaRange));
+        }
+
+        memmove(&ma->free_ranges[i + 1], &ma->free_ranges[i], 
+                (ma->num_free_ranges - i) * sizeof(MeshArenaRange));
+        ma->free_ranges[i].first = first;
+        ma->free_ranges[i].count = count;
+        ma->num_free_ranges++;
+    }
+}
+
+// Old content is copied on GPU, VAO is pointed to new buffer
+static void grow(MeshArena* ma, int min_free_count)
+{
+    int const old_capacity = ma->capacity;
+    int const new_capacity = MAX(old_capacity * 2, old_capacity + min_free_count);
+
+    GLuint const new_VBO = create_buffer(new_capacity);
+    glBindBuffer(GL_COPY_READ_BUFFER, ma->VBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_VBO);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, 
+                        old_capacity * sizeof(Vertex));
+    glDeleteBuffers(1, &ma->VBO);
+
+    ma->VBO = new_VBO;
+    ma->capacity = new_capacity;
+
+    glBindVertexArray(ma->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, ma->VBO);
+    set_vertex_layout();
+
+    insert_free_range(ma, old_capacity, new_capacity - old_capacity);
+}
+
+MeshArena* mesh_arena_create(int capacity)
+{
+    MeshArena* ma = malloc(sizeof(MeshArena));
+
+    ma->capacity = capacity;
+    ma->num_used = 0;
+
+    ma->VAO = opengl_create_vao();
+    ma->VBO = create_buffer(capacity);
+    set_vertex_layout();
+
+    ma->free_ranges_capacity = 64;
+    ma->free_ranges = malloc(ma->free_ranges_capacity * sizeof(MeshArenaRange));
+    ma->free_ranges[0].first = 0;
+    ma->free_ranges[0].count = capacity;
+    ma->num_free_ranges = 1;
+
+    return ma;
+}
+
+int mesh_arena_add(MeshArena* ma, Vertex* vertices, int count)
+{
+    // First fit, mostly reuses space of removed meshes
+    int i = 0;
+    while (i < ma->num_free_ranges && ma->free_ranges[i].count < count)
+        i++;
+
+    if (i == ma->num_free_ranges)
+    {
+        grow(ma, count);
+        return mesh_arena_add(ma, vertices, count);
+    }
+
+    MeshArenaRange* range = &ma->free_ranges[i];
+    int const first = range->first;
+    range->first += count;
+    range->count -= count;
+    if (range->count == 0)
+    {
+        memmove(range, range + 1, (ma->num_free_ranges - i - 1) * sizeof(MeshArenaRange));
+        ma->num_free_ranges--;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, ma->VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(Vertex), count * sizeof(Vertex), vertices);
+
+    ma->num_used += count;
+    return first;
+}
+
+void mesh_arena_remove(MeshArena* ma, int first, int count)
+{
+    insert_free_range(ma, first, count);
+    ma->num_used -= count;
+}
+
+void mesh_arena_destroy(MeshArena* ma)
+{
+    glDeleteVertexArrays(1, &ma->VAO);
+    glDeleteBuffers(1, &ma->VBO);
+    free(ma->free_ranges);
+    free(ma);
+}
@@ -0,0 +1,50 @@
+#ifndef MESH_ARENA_H_
+#define MESH_ARENA_H_
+
+#include <glad/glad.h>
+
+#include <utils.h>
+
+// Single GPU buffer of vertices shared by many small meshes,
+// so any of them can be drawn together by one call of
+// glMultiDrawArrays() in any order. Buffer grows when full.
+//
+// int first = mesh_arena_add(ma, vertices, count);
+// glBindVertexArray(ma->VAO);
+//     ...
+// mesh_arena_remove(ma, first, count);
+
+typedef struct
+{
+    int first;
+    int count;
+}
+MeshArenaRange;
+
+typedef struct
+{
+    GLuint VAO;
+    GLuint VBO;
+
+    // In vertices
+    int capacity;
+    int num_used;
+
+    // Free ranges sorted by first vertex, touching ranges are merged
+    MeshArenaRange* free_ranges;
+    int num_free_ranges;
+    int free_ranges_capacity;
+}
+MeshArena;
+
+// Capacity in vertices
+MeshArena* mesh_arena_create(int capacity);
+
+// Returns first vertex of mesh in arena, count has to be positive
+int mesh_arena_add(MeshArena* ma, Vertex* vertices, int count);
+
+void mesh_arena_remove(MeshArena* ma, int first, int count);
+
+void mesh_arena_destroy(MeshArena* ma);
+
+#endif
@@ -0,0 +1,440 @@
+#include <map/occlusion_culler.h>
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <utils.h>
+#include <profiler.h>
+
+#define W OCCLUSION_BUFFER_WIDTH
+#define H OCCLUSION_BUFFER_HEIGHT
+
+// Geometry closer than this (in clip space w) is clipped
+#define OCCLUSION_NEAR 0.01f
+
+// Triangles of a box, indices of corners from box_corners()
+static const int box_triangles[12][3] =
+{
+    {0, 1, 3}, {0, 3, 2}, // -x
+    {4, 6, 7}, {4, 7, 5}, // +x
+    {0, 4, 5}, {0, 5, 1}, // -y
+    {2, 3, 7}, {2, 7, 6}, // +y
+    {0, 2, 6}, {0, 6, 4}, // -z
+    {1, 5, 7}, {1, 7, 3}  // +z
+};
+
+static void box_corners(mat4 vp_matrix, vec3 box[2], vec4 res[8])
+{
+    for (int i = 0; i < 8; i++)
+    {
+        vec4 corner =
+        {
+            box[(i >> 2) & 1][0],
+            box[(i >> 1) & 1][1],
+            box[ i       & 1][2],
+            1.0f
+        };
+        glm_mat4_mulv(vp_matrix, corner, res[i]);
+    }
+}
+
+static void to_screen(vec4 clip, float* sx, float* sy)
+{
+    *sx = (clip[0] / clip[3] * 0.5f + 0.5f) * W;
+    *sy = (clip[1] / clip[3] * 0.5f + 0.5f) * H;
+}
+
+static void rasterize_triangle(float* depth, vec4 v0, vec4 v1, vec4 v2)
+{
+    float x[3], y[3], inv_w[3];
+    to_screen(v0, &x[0], &y[0]);
+    to_screen(v1, &x[1], &y[1]);
+    to_screen(v2, &x[2], &y[2]);
+    inv_w[0] = 1.0f / v0[3];
+    inv_w[1] = 1.0f / v1[3];
+    inv_w[2] = 1.0f / v2[3];
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (fabsf(area) < 1e-6f)
+        return;
+
+    // Make winding counter-clockwise, back
+    // faces are rasterized as well
+    if (area < 0.0f)
+    {
+        float tmp;
+        tmp = x[1];     x[1]     = x[2];     x[2]     = tmp;
+        tmp = y[1];     y[1]     = y[2];     y[2]     = tmp;
+        tmp = inv_w[1]; inv_w[1] = inv_w[2]; inv_w[2] = tmp;
+        area = -area;
+    }
+
+    int min_x = (int)floorf(glm_min(x[0], glm_min(x[1], x[2])));
+    int max_x = (int)ceilf (glm_max(x[0], glm_max(x[1], x[2])));
+    int min_y = (int)floorf(glm_min(y[0], glm_min(y[1], y[2])));
+    int max_y = (int)ceilf (glm_max(y[0], glm_max(y[1], y[2])));
+
+    min_x = MAX(min_x, 0);
+    min_y = MAX(min_y, 0);
+    max_x = MIN(max_x, W - 1);
+    max_y = MIN(max_y, H - 1);
+    if (min_x > max_x || min_y > max_y)
+        return;
+
+    // Edge functions e = a * px + b * py + c, which are
+    // non-negative inside of triangle for pixel centers
+    float a[3], b[3], c[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int j = (i + 1) % 3;
+        a[i] = y[i] - y[j];
+        b[i] = x[j] - x[i];
+        c[i] = -(a[i] * x[i] + b[i] * y[i]);
+    }
+
+    // 1 / w is linear in screen space. Edge i is opposite
+    // to vertex (i + 2) % 3, so it gives weight of that vertex
+    float const za = (a[1] * inv_w[0] + a[2] * inv_w[1] + a[0] * inv_w[2]) / area;
+    float const zb = (b[1] * inv_w[0] + b[2] * inv_w[1] + b[0] * inv_w[2]) / area;
+    float const zc = (c[1] * inv_w[0] + c[2] * inv_w[1] + c[0] * inv_w[2]) / area;
+
+    // Rows are processed by 4 pixels, buffer width is
+    // a multiple of 4, so it's safe to start earlier
+    min_x &= ~3;
+
+#ifdef __SSE2__
+    __m128 const lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    __m128 const zero = _mm_setzero_ps();
+
+    __m128 a4[3], step4[3];
+    for (int i = 0; i < 3; i++)
+    {
+        a4[i] = _mm_set1_ps(a[i]);
+        step4[i] = _mm_set1_ps(4.0f * a[i]);
+    }
+    __m128 const za4 = _mm_set1_ps(za);
+    __m128 const z_step4 = _mm_set1_ps(4.0f * za);
+
+    for (int py = min_y; py <= max_y; py++)
+    {
+        __m128 xs = _mm_add_ps(_mm_set1_ps((float)min_x), lane_offsets);
+        __m128 e[3];
+        for (int i = 0; i < 3; i++)
+        {
+            __m128 row = _mm_set1_ps(b[i] * (py + 0.5f) + c[i]);
+            e[i] = _mm_add_ps(_mm_mul_ps(a4[i], xs), row);
+        }
+        __m128 z = _mm_add_ps(_mm_mul_ps(za4, xs), _mm_set1_ps(zb * (py + 0.5f) + zc));
+
+        float* row_depth = depth + py * W;
+        for (int px = min_x; px <= max_x; px += 4)
+        {
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e[0], zero),
+                            _mm_and_ps(_mm_cmpge_ps(e[1], zero),
+                                       _mm_cmpge_ps(e[2], zero)));
+
+            __m128 old_depth = _mm_loadu_ps(row_depth + px);
+            __m128 new_depth = _mm_max_ps(old_depth, z);
+            new_depth = _mm_or_ps(_mm_and_ps(inside, new_depth),
+                                  _mm_andnot_ps(inside, old_depth));
+            _mm_storeu_ps(row_depth + px, new_depth);
+
+            for (int i = 0; i < 3; i++)
+                e[i] = _mm_add_ps(e[i], step4[i]);
+            z = _mm_add_ps(z, z_step4);
+        }
+    }
+#else
+    for (int py = min_y; py <= max_y; py++)
+    {
+        float* row_depth = depth + py * W;
+        for (int px = min_x; px <= max_x; px++)
+        {
+            float const fx = px + 0.5f;
+            float const fy = py + 0.5f;
+
+            if (a[0] * fx + b[0] * fy + c[0] >= 0.0f &&
+                a[1] * fx + b[1] * fy + c[1] >= 0.0f &&
+                a[2] * fx + b[2] * fy + c[2] >= 0.0f)
+            {
+                row_depth[px] = glm_max(row_depth[px], za * fx + zb * fy + zc);
+            }
+        }
+    }
+#endif
+}
+
+// Clip triangle by w = OCCLUSION_NEAR plane, it
+// gives 0, 1 or 2 triangles which are rasterized
+static void clip_and_rasterize_triangle(float* depth, vec4 v[3])
+{
+    vec4 poly[4];
+    int num_poly = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        float* curr = v[i];
+        float* next = v[(i + 1) % 3];
+
+        int curr_inside = curr[3] >= OCCLUSION_NEAR;
+        int next_inside = next[3] >= OCCLUSION_NEAR;
+
+        if (curr_inside)
+            glm_vec4_copy(curr, poly[num_poly++]);
+
+        if (curr_inside != next_inside)
+        {
+            float t = (OCCLUSION_NEAR - curr[3]) / (next[3] - curr[3]);
+            glm_vec4_lerp(curr, next, t, poly[num_poly++]);
+        }
+    }
+
+    for (int i = 1; i + 1 < num_poly; i++)
+        rasterize_triangle(depth, poly[0], poly[i], poly[i + 1]);
+}
+
+static void rasterize_occluder(OcclusionCuller* oc, vec3 box[2])
+{
+    vec4 corners[8];
+    box_corners(oc->vp_matrix, box, corners);
+
+    for (int i = 0; i < 12; i++)
+    {
+        vec4 tri[3];
+        for (int j = 0; j < 3; j++)
+            glm_vec4_copy(corners[box_triangles[i][j]], tri[j]);
+
+        clip_and_rasterize_triangle(oc->depth, tri);
+    }
+}
+
+static int is_object_visible(OcclusionCuller* oc, vec3 box[2])
+{
+    vec4 corners[8];
+    box_corners(oc->vp_matrix, box, corners);
+
+    float min_sx =  FLT_MAX, min_sy =  FLT_MAX;
+    float max_sx = -FLT_MAX, max_sy = -FLT_MAX;
+    float max_inv_w = 0.0f;
+
+    for (int i = 0; i < 8; i++)
+    {
+        // Box crosses near plane, so it's really close
+        if (corners[i][3] < OCCLUSION_NEAR)
+            return 1;
+
+        float sx, sy;
+        to_screen(corners[i], &sx, &sy);
+        min_sx = glm_min(min_sx, sx);
+        min_sy = glm_min(min_sy, sy);
+        max_sx = glm_max(max_sx, sx);
+        max_sy = glm_max(max_sy, sy);
+        max_inv_w = glm_max(max_inv_w, 1.0f / corners[i][3]);
+    }
+
+    int min_x = MAX((int)floorf(min_sx), 0);
+    int min_y = MAX((int)floorf(min_sy), 0);
+    int max_x = MIN((int)floorf(max_sx), W - 1);
+    int max_y = MIN((int)floorf(max_sy), H - 1);
+
+    // Not on screen, let frustum culling decide
+    if (min_x > max_x || min_y > max_y)
+        return 1;
+
+#ifdef __SSE2__
+    __m128 const max_inv_w4 = _mm_set1_ps(max_inv_w);
+    __m128i const lanes = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i const first = _mm_set1_epi32(min_x - 1);
+    __m128i const last  = _mm_set1_epi32(max_x + 1);
+
+    for (int py = min_y; py <= max_y; py++)
+    {
+        float* row_depth = oc->depth + py * W;
+        for (int px = min_x & ~3; px <= max_x; px += 4)
+        {
+            // Only pixels from min_x to max_x are tested
+            __m128i xs = _mm_add_epi32(_mm_set1_epi32(px), lanes);
+            __m128i in_rect = _mm_and_si128(_mm_cmpgt_epi32(xs, first),
+                                            _mm_cmplt_epi32(xs, last));
+
+            __m128 further = _mm_cmplt_ps(_mm_loadu_ps(row_depth + px), max_inv_w4);
+            if (_mm_movemask_ps(_mm_and_ps(further, _mm_castsi128_ps(in_rect))))
+                return 1;
+        }
+    }
+#else
+    for (int py = min_y; py <= max_y; py++)
+    for (int px = min_x; px <= max_x; px++)
+    {
+        if (oc->depth[py * W + px] < max_inv_w)
+            return 1;
+    }
+#endif
+
+    return 0;
+}
+
+static void occlusion_culler_run(OcclusionCuller* oc)
+{
+    PROFILER_ZONE_BEGIN("occlusion_culler_run");
+
+    memset(oc->depth, 0, W * H * sizeof(float));
+
+    for (int i = 0; i < oc->num_occluders; i++)
+        rasterize_occluder(oc, oc->occluders[i]);
+
+    for (int i = 0; i < oc->num_objects; i++)
+        oc->is_visible[i] = is_object_visible(oc, oc->objects[i]);
+
+    PROFILER_ZONE_END();
+}
+
+static int occlusion_culler_loop(void* data)
+{
+    OcclusionCuller* oc = (OcclusionCuller*)data;
+    profiler_set_thread_name("occlusion culler");
+
+    while (true)
+    {
+        mtx_lock(&oc->state_mtx);
+        while (oc->state != OCCLUSION_BUSY && oc->state != OCCLUSION_EXIT)
+            cnd_wait(&oc->cond_var, &oc->state_mtx);
+
+        if (oc->state == OCCLUSION_EXIT)
+            break;
+
+        mtx_unlock(&oc->state_mtx);
+
+        occlusion_culler_run(oc);
+
+        mtx_lock(&oc->state_mtx);
+        if (oc->state == OCCLUSION_EXIT)
+            break;
+        oc->state = OCCLUSION_IDLE;
+        cnd_signal(&oc->cond_var);
+        mtx_unlock(&oc->state_mtx);
+    }
+
+    mtx_unlock(&oc->state_mtx);
+    thrd_exit(0);
+}
+
+OcclusionCuller* occlusion_culler_create(int use_thread)
+{
+    OcclusionCuller* oc = malloc(sizeof(OcclusionCuller));
+
+    oc->depth = malloc(W * H * sizeof(float));
+
+    oc->occluders_capacity = 256;
+    oc->occluders = malloc(oc->occluders_capacity * sizeof(*oc->occluders));
+    oc->num_occluders = 0;
+
+    oc->objects_capacity = 256;
+    oc->objects = malloc(oc->objects_capacity * sizeof(*oc->objects));
+    oc->is_visible = malloc(oc->objects_capacity);
+    oc->num_objects = 0;
+
+    glm_mat4_identity(oc->vp_matrix);
+
+    oc->use_thread = use_thread;
+    oc->state = OCCLUSION_IDLE;
+    if (use_thread)
+    {
+        cnd_init(&oc->cond_var);
+        mtx_init(&oc->state_mtx, mtx_plain);
+        thrd_create(&oc->thread, occlusion_culler_loop, oc);
+    }
+
+    return oc;
+}
+
+void occlusion_culler_reset(OcclusionCuller* oc, mat4 vp_matrix)
+{
+    glm_mat4_copy(vp_matrix, oc->vp_matrix);
+    oc->num_occluders = 0;
+    oc->num_objects = 0;
+}
+
+void occlusion_culler_add_occluder(OcclusionCuller* oc, vec3 box[2])
+{
+    if (oc->num_occluders == oc->occluders_capacity)
+    {
+        oc->occluders_capacity *= 2;
+        oc->occluders = realloc(oc->occluders, oc->occluders_capacity * sizeof(*oc->occluders));
+    }
+
+    glm_vec3_copy(box[0], oc->occluders[oc->num_occluders][0]);
+    glm_vec3_copy(box[1], oc->occluders[oc->num_occluders][1]);
+    oc->num_occluders++;
+}
+
+int occlusion_culler_add_object(OcclusionCuller* oc, vec3 box[2])
+{
+    if (oc->num_objects == oc->objects_capacity)
+    {
+        oc->objects_capacity *= 2;
+        oc->objects = realloc(oc->objects, oc->objects_capacity * sizeof(*oc->objects));
+        oc->is_visible = realloc(oc->is_visible, oc->objects_capacity);
+    }
+
+    glm_vec3_copy(box[0], oc->objects[oc->num_objects][0]);
+    glm_vec3_copy(box[1], oc->objects[oc->num_objects][1]);
+    oc->is_visible[oc->num_objects] = 1;
+    return oc->num_objects++;
+}
+
+void occlusion_culler_start(OcclusionCuller* oc)
+{
+    if (!oc->use_thread)
+    {
+        occlusion_culler_run(oc);
+        return;
+    }
+
+    mtx_lock(&oc->state_mtx);
+    oc->state = OCCLUSION_BUSY;
+    cnd_signal(&oc->cond_var);
+    mtx_unlock(&oc->state_mtx);
+}
+
+void occlusion_culler_wait(OcclusionCuller* oc)
+{
+    if (!oc->use_thread)
+        return;
+
+    mtx_lock(&oc->state_mtx);
+    while (oc->state == OCCLUSION_BUSY)
+        cnd_wait(&oc->cond_var, &oc->state_mtx);
+    mtx_unlock(&oc->state_mtx);
+}
+
+int occlusion_culler_is_visible(OcclusionCuller* oc, int id)
+{
+    return oc->is_visible[id];
+}
+
+void occlusion_culler_destroy(OcclusionCuller* oc)
+{
+    if (oc->use_thread)
+    {
+        mtx_lock(&oc->state_mtx);
+        oc->state = OCCLUSION_EXIT;
+        cnd_signal(&oc->cond_var);
+        mtx_unlock(&oc->state_mtx);
+
+        thrd_join(oc->thread, NULL);
+        mtx_destroy(&oc->state_mtx);
+        cnd_destroy(&oc->cond_var);
+    }
+
+    free(oc->depth);
+    free(oc->occluders);
+    free(oc->objects);
+    free(oc->is_visible);
+    free(oc);
+}
@@ -0,0 +1,77 @@
+#ifndef OCCLUSION_CULLER_H_
+#define OCCLUSION_CULLER_H_
+
+#include <cglm/cglm.h>
+#include <tinycthread.h>
+
+// Resolution of software depth buffer, width
+// has to be a multiple of 4
+#define OCCLUSION_BUFFER_WIDTH  256
+#define OCCLUSION_BUFFER_HEIGHT 128
+
+// CPU occlusion culling, doesn't need OpenGL. Occluder boxes are
+// rasterized into a small depth buffer, then screen rectangles of
+// object boxes are tested against it with the depth of their
+// closest corner, so bigger and closer than they really are.
+//
+// occlusion_culler_reset(oc, vp_matrix);
+// occlusion_culler_add_occluder(oc, box);
+// int id = occlusion_culler_add_object(oc, box);
+// occlusion_culler_start(oc);
+//     ...
+// occlusion_culler_wait(oc);
+// if (occlusion_culler_is_visible(oc, id)) ...
+
+typedef enum
+{
+    OCCLUSION_IDLE,
+    OCCLUSION_BUSY,
+    OCCLUSION_EXIT
+}
+OcclusionCullerState;
+
+typedef struct
+{
+    // 1 / w in clip space of every pixel, 0 is infinitely far
+    float* depth;
+    mat4 vp_matrix;
+
+    vec3 (*occluders)[2];
+    int num_occluders;
+    int occluders_capacity;
+
+    vec3 (*objects)[2];
+    unsigned char* is_visible;
+    int num_objects;
+    int objects_capacity;
+
+    int use_thread;
+    thrd_t thread;
+    OcclusionCullerState state;
+    mtx_t state_mtx;
+    cnd_t cond_var;
+}
+OcclusionCuller;
+
+// If use_thread is set, culling runs on separate thread between
+// occlusion_culler_start() and occlusion_culler_wait(),
+// otherwise it's done right in occlusion_culler_start()
+OcclusionCuller* occlusion_culler_create(int use_thread);
+
+// Forget all boxes from previous frame
+void occlusion_culler_reset(OcclusionCuller* oc, mat4 vp_matrix);
+
+void occlusion_culler_add_occluder(OcclusionCuller* oc, vec3 box[2]);
+
+// Returns id of object to get result with
+int occlusion_culler_add_object(OcclusionCuller* oc, vec3 box[2]);
+
+void occlusion_culler_start(OcclusionCuller* oc);
+
+void occlusion_culler_wait(OcclusionCuller* oc);
+
+int occlusion_culler_is_visible(OcclusionCuller* oc, int id);
+
+void occlusion_culler_destroy(OcclusionCuller* oc);
+
+#endif
@@ -1,10 +1,16 @@
 #include <map/thread_worker.h>
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <map/map.h>
+#include <map/light.h>
+#include <profiler.h>
 
 int worker_loop(void* _data)
 {
     WorkerData* data = (WorkerData*)_data;
+    profiler_set_thread_name("chunk worker");
 
     while (true)
     {
@@ -17,9 +23,33 @@ int worker_loop(void* _data)
         
         mtx_unlock(&data->state_mtx);
 
+        // Main thread may start to unload chunk at any moment,
+        // then there's no point to light and mesh it
+        int is_unloading = 0;
         if (data->generate_terrain)
+        {
+            PROFILER_ZONE_BEGIN("chunk_generate_terrain");
             chunk_generate_terrain(data->chunk);
-        chunk_generate_mesh(data->chunk);
+            PROFILER_ZONE_END();
+
+            if (data->generate_mesh)
+                is_unloading = !chunk_try_set_state(data->chunk, CHUNK_GENERATING, CHUNK_MESHING);
+        }
+        else
+            is_unloading = chunk_get_state(data->chunk) == CHUNK_UNLOADING;
+
+        data->outdated_neighs = 0;
+        if (data->generate_mesh && !is_unloading)
+        {
+            PROFILER_ZONE_BEGIN("light_update");
+            light_update(data->chunk, data->neighs, data->light_edits, data->num_light_edits);
+            data->outdated_neighs = light_get_outdated_neighs(data->chunk, data->neighs);
+            PROFILER_ZONE_END();
+
+            PROFILER_ZONE_BEGIN("chunk_generate_mesh");
+            chunk_generate_mesh(data->chunk, data->mesh_buffers);
+            PROFILER_ZONE_END();
+        }
 
         mtx_lock(&data->state_mtx);
         if (data->state == WORKER_EXIT)
@@ -38,6 +68,14 @@ void worker_create(Worker* worker, thrd_start_t func)
     worker->data.state = WORKER_IDLE;
     worker->data.chunk = NULL;
     worker->data.generate_terrain = 0;
+    worker->data.generate_mesh = 0;
+    worker->data.is_prefetch = 0;
+    memset(worker->data.neighs, 0, sizeof(worker->data.neighs));
+    worker->data.light_edits = NULL;
+    worker->data.num_light_edits = 0;
+    worker->data.light_edits_capacity = 0;
+    worker->data.outdated_neighs = 0;
+    worker->data.mesh_buffers = chunk_mesh_buffers_create();
     
     thrd_create(&worker->thread, func, &worker->data);
 }
@@ -52,4 +90,6 @@ void worker_destroy(Worker* worker)
     thrd_join(worker->thread, NULL);
     mtx_destroy(&worker->data.state_mtx);
     cnd_destroy(&worker->data.cond_var);
+    free(worker->data.light_edits);
+    chunk_mesh_buffers_destroy(worker->data.mesh_buffers);
 }
\ No newline at end of file
@@ -21,6 +21,27 @@ typedef struct
     Chunk* chunk;
     int generate_terrain;
 
+    // Light and mesh are skipped for prefetched chunks, chunk
+    // stays in CHUNK_GENERATING until main thread takes it
+    int generate_mesh;
+    int is_prefetch;
+
+    // Neighbours whose light is read by the job, pinned with
+    // num_readers. Set by LIGHT_NEIGH(), missing ones are NULL
+    Chunk* neighs[9];
+
+    // Copy of chunk's light edits, so main thread can keep adding them
+    int* light_edits;
+    int num_light_edits;
+    int light_edits_capacity;
+
+    // Result of light_get_outdated_neighs()
+    int outdated_neighs;
+
+    // Mesh is kept here until main thread uploads it, worker
+    // gets the next job only after that
+    ChunkMeshBuffers* mesh_buffers;
+
     WorkerState state;
     mtx_t state_mtx;
     cnd_t cond_var;
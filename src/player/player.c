@@ -1,6 +1,9 @@
 #include <player/player.h>
 
+#include <string.h>
+
 #include <map/block.h>
+#include <map/light.h>
 #include <utils.h>
 #include <map/map.h>
 #include <shader.h>
@@ -20,17 +23,19 @@ static void regenerate_item_buffer(Player* p)
     Vertex* vertices = malloc(36 * sizeof(Vertex));
     int faces[6] = {1, 1, 1, 1, 1, 1};
     float ao[6][4] = {0};
+    unsigned char light[6];
+    memset(light, LIGHT_FULL_SKY, sizeof(light));
     int curr_vertex_count = 0;
 
     if (block_is_plant(p->build_block))
     {
         gen_plant_vertices(vertices, &curr_vertex_count, 
-                           0, 0, 0, p->build_block, 1.0f);
+                           0, 0, 0, p->build_block, 1.0f, LIGHT_FULL_SKY);
     }
     else
     {
         gen_cube_vertices(vertices, &curr_vertex_count, 0, 0, 0, 
-                          p->build_block, 1.0f, 0, faces, ao);
+                          p->build_block, 1.0f, 0, faces, ao, light);
     }
 
     p->VAO_item = opengl_create_vao();
@@ -40,6 +45,7 @@ static void regenerate_item_buffer(Player* p)
     opengl_vbo_layout(2, 1, GL_FLOAT,         GL_FALSE, sizeof(Vertex), 5 * sizeof(float));
     opengl_vbo_layout(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float));
     opengl_vbo_layout(4, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float) + 1);
+    opengl_vbo_layout(5, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Vertex), 6 * sizeof(float) + 2);
 
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -100,6 +106,11 @@ void player_update_hitbox(Player* p)
     p->hitbox[1][2] = p->pos[2] + BLOCK_SIZE * 0.3f;
 }
 
+void player_interpolate(Player* p, float alpha)
+{
+    glm_vec3_lerp(p->prev_pos, p->pos, alpha, p->render_pos);
+}
+
 static void player_put_on_ground_level(Player* p)
 {
     int bx = CHUNK_WIDTH / 2;
@@ -126,6 +137,7 @@ Player* player_create()
     p->build_block = BLOCK_PLAYER_HAND;
     p->pointing_at_block = 0;
     my_glm_ivec3_set(p->block_pointed_at, 0, 0, 0);
+    my_glm_ivec3_set(p->block_pointed_normal, 0, 0, 0);
 
     glm_vec3_fill(p->pos, 0.0f);
     int is_player_in_db = db_has_player_info();
@@ -138,6 +150,8 @@ Player* player_create()
         player_put_on_ground_level(p);
 
     player_update_hitbox(p);
+    glm_vec3_copy(p->pos, p->prev_pos);
+    glm_vec3_copy(p->pos, p->render_pos);
 
     p->on_ground = 0;
     p->in_water = 0;
@@ -154,55 +168,17 @@ Player* player_create()
 // TODO: Move to camera class
 static void update_block_pointing_at(Player* p)
 {
-    float cam_x = blocked(p->pos[0]);
-    float cam_y = blocked(p->pos[1]);
-    float cam_z = blocked(p->pos[2]);
-    int icam_x = (int)cam_x;
-    int icam_y = (int)cam_y;
-    int icam_z = (int)cam_z;
-
-    int found = 0;
-    int best_x = 0, best_y = 0, best_z = 0;
-    float best_dist = BLOCK_BREAK_RADIUS2 * 2;
-
-    // Iterate over each block around player
-    for (int y = icam_y - BLOCK_BREAK_RADIUS; y <= icam_y + BLOCK_BREAK_RADIUS; y++)
-    {
-        if (y < 0 || y >= CHUNK_HEIGHT) continue;
-
-        for (int x = icam_x - BLOCK_BREAK_RADIUS; x <= icam_x + BLOCK_BREAK_RADIUS; x++)
-        for (int z = icam_z - BLOCK_BREAK_RADIUS; z <= icam_z + BLOCK_BREAK_RADIUS; z++)
-        {
-            if (block_player_dist2(x, y, z, cam_x, cam_y, cam_z) > BLOCK_BREAK_RADIUS2)
-                continue;
-            
-            unsigned char block = map_get_block(x, y, z);
-            if (!block_is_solid(block))
-                continue;
-            
-            if (block_ray_intersection(p->pos, p->front, x, y, z, block))
-            {
-                float distance = block_player_dist2(x, y, z, cam_x, cam_y, cam_z);
-                if (distance < best_dist)
-                {
-                    best_dist = distance;
-                    best_x = x;
-                    best_y = y;
-                    best_z = z;
-                    found = 1;
-                }
-            }
-        }
-    }
-
-    if (!found)
+    // Ray goes from camera, pos may be up to one tick ahead of it
+    MapRaycastHit hit;
+    if (!map_raycast(p->render_pos, p->front, BLOCK_BREAK_RADIUS * BLOCK_SIZE, &hit))
     {
         p->pointing_at_block = 0;
         return;
     }
 
     p->pointing_at_block = 1;
-    my_glm_ivec3_set(p->block_pointed_at, best_x, best_y, best_z);
+    my_glm_ivec3_set(p->block_pointed_at, hit.block[0], hit.block[1], hit.block[2]);
+    my_glm_ivec3_set(p->block_pointed_normal, hit.normal[0], hit.normal[1], hit.normal[2]);
 }
 
 void player_set_build_block(Player* p, int new_block)
@@ -227,7 +203,7 @@ void player_set_build_block(Player* p, int new_block)
     regenerate_item(p);
 }
 
-static void check_if_in_water(Player* p)
+void player_update_in_water(Player* p)
 {
     int player_x = (int)blocked(p->pos[0]);
     int player_y = (int)blocked(p->pos[1]);
@@ -278,7 +254,6 @@ void player_set_viewdir(Player* p, float pitch, float yaw)
 
 void player_update(Player* p, double dt)
 {
-    check_if_in_water(p);
     update_block_pointing_at(p);
 }
 
@@ -300,7 +275,6 @@ void player_render_item(Player* p)
     glUseProgram(shader_handitem);
     shader_set_mat4(shader_handitem, "mvp_matrix", mvp);
     shader_set_texture_array(shader_handitem, "texture_sampler", texture_blocks, 0);
-    shader_set_float1(shader_handitem, "block_light", map_get_blocks_light());
 
     glDisable(GL_BLEND);
     glBindVertexArray(p->VAO_item);
@@ -10,6 +10,11 @@ typedef struct
 {
     vec3 pos;
 
+    // Position before last simulation tick and position between
+    // it and pos that is rendered, see player_interpolate()
+    vec3 prev_pos;
+    vec3 render_pos;
+
     vec3 front;
     vec3 up;
     vec3 speed;
@@ -21,6 +26,9 @@ typedef struct
     int pointing_at_block;
     ivec3 block_pointed_at;
 
+    // Normal of pointed face, new block is placed next to it
+    ivec3 block_pointed_normal;
+
     vec3 hitbox[2];
 
     int on_ground;
@@ -38,8 +46,12 @@ Player* player_create();
 
 void player_set_build_block(Player* p, int new_block);
 
+// Per-frame work that follows rendered position
 void player_update(Player* p, double dt);
 
+// Sets in_water from hitbox, done in every simulation tick
+void player_update_in_water(Player* p);
+
 void player_handle_left_mouse_click(Player* p);
 
 void player_handle_right_mouse_click(Player* p);
@@ -48,6 +60,9 @@ void player_render_item(Player* p);
 
 void player_update_hitbox(Player* p);
 
+// Sets render_pos, alpha is share of next tick that has passed
+void player_interpolate(Player* p, float alpha);
+
 void player_set_viewdir(Player* p, float pitch, float yaw);
 
 void player_save(Player* p);
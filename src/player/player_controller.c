@@ -29,27 +29,6 @@ static void on_left_mouse_button(PlayerController* pc)
     p->pointing_at_block = 0;
 }
 
-static void find_best_spot_to_place_block(Player* player, int x, int y, int z, int* best_x, 
-                                          int* best_y, int* best_z, float* best_dist)
-{
-    float player_x = blocked(player->pos[0]);
-    float player_y = blocked(player->pos[1]);
-    float player_z = blocked(player->pos[2]);
-    
-    if (block_ray_intersection(player->pos, player->front, x, y, z, BLOCK_AIR) 
-        && !block_is_solid(map_get_block(x, y, z)))
-    {
-        float dist = block_player_dist2(x, y, z, player_x, player_y, player_z);
-        if (dist < *best_dist)
-        {
-            *best_dist = dist;
-            *best_x = x;
-            *best_y = y;
-            *best_z = z;
-        }
-    }
-}
-
 static void on_right_mouse_button(PlayerController* pc)
 {
     Player* p = pc->player;
@@ -57,30 +36,20 @@ static void on_right_mouse_button(PlayerController* pc)
     if (!p->pointing_at_block || p->build_block == BLOCK_PLAYER_HAND)
         return;
 
-    int x = p->block_pointed_at[0];
-    int y = p->block_pointed_at[1];
-    int z = p->block_pointed_at[2];
-
-    int best_x = 0, best_y = 0, best_z = 0;
-    float best_dist = BLOCK_BREAK_RADIUS2 * 2;
+    // Cell before pointed block along the ray
+    int x = p->block_pointed_at[0] + p->block_pointed_normal[0];
+    int y = p->block_pointed_at[1] + p->block_pointed_normal[1];
+    int z = p->block_pointed_at[2] + p->block_pointed_normal[2];
 
-    // 6 potential spots around active block
-    find_best_spot_to_place_block(p, x - 1, y, z, &best_x, &best_y, &best_z, &best_dist);
-    find_best_spot_to_place_block(p, x + 1, y, z, &best_x, &best_y, &best_z, &best_dist);
-    find_best_spot_to_place_block(p, x, y - 1, z, &best_x, &best_y, &best_z, &best_dist);
-    find_best_spot_to_place_block(p, x, y + 1, z, &best_x, &best_y, &best_z, &best_dist);
-    find_best_spot_to_place_block(p, x, y, z - 1, &best_x, &best_y, &best_z, &best_dist);
-    find_best_spot_to_place_block(p, x, y, z + 1, &best_x, &best_y, &best_z, &best_dist);
-
-    if ((best_dist > BLOCK_BREAK_RADIUS2) || best_y < 0 || best_y >= CHUNK_HEIGHT)
+    if (y < 0 || y >= CHUNK_HEIGHT || block_is_solid(map_get_block(x, y, z)))
         return;
 
     vec3 block_hitbox[2];
-    block_gen_aabb(best_x, best_y, best_z, block_hitbox);
+    block_gen_aabb(x, y, z, block_hitbox);
     if (aabb_collide(p->hitbox, block_hitbox))
         return;
 
-    map_set_block(best_x, best_y, best_z, p->build_block);
+    map_set_block(x, y, z, p->build_block);
 }
 
 static void pc_on_mouse_button_callback(void* this_object, int glfw_keycode, int glfw_action_code)
@@ -385,12 +354,12 @@ static void gen_motion_vector_fly(PlayerController* pc, double dt, vec3 res)
     glm_vec3_scale(res, dt * pc->fly_speed, res);
 }
 
-static void gen_frame_motion(PlayerController* pc, vec3 out)
+static void gen_frame_motion(PlayerController* pc, double dt, vec3 out)
 {
     if (pc->is_fly_mode)
-        gen_motion_vector_fly(pc, dt_get(), out);
+        gen_motion_vector_fly(pc, dt, out);
     else
-        gen_motion_vector_walk(pc, dt_get(), out);
+        gen_motion_vector_walk(pc, dt, out);
 }
 
 static void pc_on_keyboard_key_callback(void* this_object, int glfw_keycode, int glfw_action_code)
@@ -411,18 +380,27 @@ static void pc_on_keyboard_key_callback(void* this_object, int glfw_keycode, int
     }
 }
 
-void playercontroller_do_control(PlayerController* pc)
+void playercontroller_update_view(PlayerController* pc)
 {
     update_dir(pc);
+}
 
+void playercontroller_do_control(PlayerController* pc, double dt)
+{
     vec3 frame_motion;
-    gen_frame_motion(pc, frame_motion);
+    gen_frame_motion(pc, dt, frame_motion);
 
     if (pc->is_fly_mode)
+    {
         glm_vec3_add(pc->player->pos, frame_motion, pc->player->pos);
+        player_update_hitbox(pc->player);
+    }
     else
         player_collide_with_map(pc->player, frame_motion);
 
+    // The next tick uses water state of this one
+    player_update_in_water(pc->player);
+
     // printf("%.3f %.3f %.3f\n", pc->player->front[0], pc->player->front[1], pc->player->front[2]);
 }
 
@@ -25,7 +25,11 @@ PlayerController;
 
 PlayerController* playercontroller_create(Player* p);
 
-void playercontroller_do_control(PlayerController* pc);
+// Mouse look, done every frame so view doesn't lag behind
+void playercontroller_update_view(PlayerController* pc);
+
+// One simulation tick of player movement and physics
+void playercontroller_do_control(PlayerController* pc, double dt);
 
 void playercontroller_destroy(PlayerController* pc);
 #endif
\ No newline at end of file
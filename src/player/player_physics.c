@@ -4,127 +4,152 @@
 #include <map/block.h>
 #include <utils.h>
 
-#define FOREACH_SOLID_BLOCK_AROUND(PX, PY, PZ)                  \
-for (int y = -3; y <= 3; y++)                                   \
-{                                                               \
-    int by = PY + y;                                            \
-    if (by < 0 || by >= CHUNK_HEIGHT)                           \
-        continue;                                               \
-                                                                \
-    for (int x = -3; x <= 3; x++)                               \
-    for (int z = -3; z <= 3; z++)                               \
-    {                                                           \
-        int bx = PX + x;                                        \
-        int bz = PZ + z;                                        \
-                                                                \
-        unsigned char block = map_get_block(bx, by, bz);        \
-        if (!block_is_solid(block) || block_is_plant(block))    \
-            continue;                                           \
-                                                                \
-        vec3 block_hitbox[2];                                   \
-        block_gen_aabb(bx, by, bz, block_hitbox);            
-
-#define FOREACH_SOLID_BLOCK_AROUND_END() }}
-
-static void collision_x(Player* p, vec3 block_hitbox[2])
+// Blocks around hitbox and its motion, allocated once for the
+// longest motion of one tick instead of on every call
+static unsigned char* grid_cells = NULL;
+static int grid_capacity = 0;
+
+static float get_max_motion_per_tick()
 {
-    int const moving_to_plus_x = (p->speed[0] >= 0);
-    
-    if (moving_to_plus_x)
-        p->pos[0] -= (p->hitbox[1][0] - block_hitbox[0][0]) + 0.00001f;
-    else
-        p->pos[0] += (block_hitbox[1][0] - p->hitbox[0][0]) + 0.00001f;
-    
-    p->speed[0] = 0.0f;
+    float speed = MAX(MAX_RUN_SPEED, MAX_MOVE_SPEED);
+    speed = MAX(speed, MAX_SWIM_SPEED);
+    speed = MAX(speed, MAX_FALL_SPEED);
+    speed = MAX(speed, MAX_DIVE_SPEED);
+    speed = MAX(speed, MAX_EMERGE_SPEED);
+    speed = MAX(speed, JUMP_POWER);
+    return speed / SIMULATION_RATE;
 }
 
-static void collision_y(Player* p, vec3 block_hitbox[2])
+// Every axis of grid spans hitbox and its motion, one
+// block more in case it ends exactly on block border
+static int get_grid_capacity(Player* p, float max_motion)
 {
-    int const moving_to_plus_y = (p->speed[1] >= 0);
-    
-    if (moving_to_plus_y)
-        p->pos[1] -= (p->hitbox[1][1] - block_hitbox[0][1]) + 0.00001f;
-    else
+    int capacity = 1;
+    for (int i = 0; i < 3; i++)
     {
-        p->pos[1] += (block_hitbox[1][1] - p->hitbox[0][1]) + 0.00001f;
-        p->on_ground = 1;
+        float const span = p->hitbox[1][i] - p->hitbox[0][i] + max_motion;
+        capacity *= (int)ceilf(blocked(span)) + 2;
     }
-
-    p->speed[1] = 0.0f;
+    return capacity;
 }
 
-static void collision_z(Player* p, vec3 block_hitbox[2])
+static int slab_has_solid(MapCollisionGrid* grid, int min[3], int max[3])
 {
-    int const moving_to_plus_z = (p->speed[2] >= 0);
-    
-    if (moving_to_plus_z)
-        p->pos[2] -= (p->hitbox[1][2] - block_hitbox[0][2]) + 0.00001f;
-    else
-        p->pos[2] += (block_hitbox[1][2] - p->hitbox[0][2]) + 0.00001f;
-
-    p->speed[2] = 0.0f;
+    for (int bx = min[0]; bx <= max[0]; bx++)
+    for (int by = min[1]; by <= max[1]; by++)
+    for (int bz = min[2]; bz <= max[2]; bz++)
+    {
+        if (map_collision_grid_get(grid, bx, by, bz))
+            return 1;
+    }
+    return 0;
 }
 
-static int collide_one_axis(void (*collision_handler)
-                            (Player*, vec3 block_hitbox[2]), Player* p)
+// Moves hitbox along one axis up to first solid slab of blocks in
+// front of it, slabs are one block thick and as wide as hitbox.
+// Returns 1 if hitbox was stopped by a block
+static int sweep_axis(Player* p, int axis, float motion, MapCollisionGrid* grid)
 {
-    int player_x = (int)blocked(p->pos[0]);
-    int player_y = (int)blocked(p->pos[1]);
-    int player_z = (int)blocked(p->pos[2]);
-
     player_update_hitbox(p);
 
-    FOREACH_SOLID_BLOCK_AROUND(player_x, player_y, player_z)
-        if (aabb_collide(p->hitbox, block_hitbox))
-        {
-            collision_handler(p, block_hitbox);
-            player_update_hitbox(p);
-            return 1;
-        }
-    FOREACH_SOLID_BLOCK_AROUND_END()
+    // Only blocks overlapping hitbox on other axes can be hit
+    int min[3], max[3];
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = (int)floorf(blocked(p->hitbox[0][i]));
+        max[i] = (int)ceilf(blocked(p->hitbox[1][i])) - 1;
+    }
+
+    int const dir = (motion > 0.0f) ? 1 : -1;
+    float const face = (dir > 0) ? p->hitbox[1][axis] : p->hitbox[0][axis];
+    int const first = (int)floorf(blocked(face));
+    int const last = (int)floorf(blocked(face + motion));
+
+    for (int b = first; b != last + dir; b += dir)
+    {
+        min[axis] = max[axis] = b;
+        if (!slab_has_solid(grid, min, max))
+            continue;
+
+        // Stop just before block face, hitbox already inside
+        // the block is pushed out of it
+        float const block_face = (dir > 0 ? b : b + 1) * BLOCK_SIZE;
+        float const allowed = block_face - face - dir * 0.00001f;
+        p->pos[axis] += (dir > 0) ? MIN(motion, allowed) : MAX(motion, allowed);
+        p->speed[axis] = 0.0f;
+        if (axis == 1 && dir < 0)
+            p->on_ground = 1;
+        return 1;
+    }
 
+    p->pos[axis] += motion;
     return 0;
 }
 
-static void collide_all_axes(Player* p, vec3 motion, ivec3 do_collide)
+// Axes are resolved in order y, x, z. Axis that was stopped
+// by a block doesn't move in later parts of motion
+static void sweep_all_axes(Player* p, vec3 motion, ivec3 do_collide)
 {
-    if (do_collide[1])
-    {
-        p->on_ground = 0;
-        p->pos[1] += motion[1];
-        do_collide[1] = !collide_one_axis(collision_y, p);
-    }
-    if (do_collide[0])
+    player_update_hitbox(p);
+
+    ivec3 min, max;
+    for (int i = 0; i < 3; i++)
     {
-        p->pos[0] += motion[0];
-        do_collide[0] = !collide_one_axis(collision_x, p);
+        float const lo = p->hitbox[0][i] + MIN(motion[i], 0.0f);
+        float const hi = p->hitbox[1][i] + MAX(motion[i], 0.0f);
+        min[i] = (int)floorf(blocked(lo));
+        max[i] = (int)floorf(blocked(hi));
     }
-    if (do_collide[2])
+
+    MapCollisionGrid grid;
+    grid.cells = grid_cells;
+    map_collision_grid_fill(&grid, min, max);
+
+    int const order[3] = { 1, 0, 2 };
+    for (int i = 0; i < 3; i++)
     {
-        p->pos[2] += motion[2];
-        do_collide[2] = !collide_one_axis(collision_z, p);
+        int const axis = order[i];
+        if (!do_collide[axis])
+            continue;
+        if (axis == 1)
+            p->on_ground = 0;
+        if (motion[axis] != 0.0f)
+            do_collide[axis] = !sweep_axis(p, axis, motion[axis], &grid);
     }
+
+    player_update_hitbox(p);
 }
 
 void player_collide_with_map(Player* p, vec3 motion)
 {
-    
-    float const max_step_size = 0.25f * BLOCK_SIZE;
+    float const max_motion = get_max_motion_per_tick();
 
-    float magnitude = glm_vec3_norm(motion);
-    if (magnitude < 0.00001f)
+    float longest = 0.0f;
+    for (int i = 0; i < 3; i++)
+        longest = MAX(longest, fabsf(motion[i]));
+    if (longest < 0.00001f)
         return;
-    
-    int num_steps = 1 + (magnitude / max_step_size);
-    float step_size = magnitude / num_steps;
 
-    vec3 step_motion;
-    glm_vec3_copy(motion, step_motion);
-    glm_vec3_scale(step_motion, (1.0f / magnitude) * step_size, step_motion);
+    player_update_hitbox(p);
+
+    int const capacity = get_grid_capacity(p, max_motion);
+    if (capacity > grid_capacity)
+    {
+        free(grid_cells);
+        grid_cells = malloc(capacity);
+        grid_capacity = capacity;
+    }
+
+    // Motion of one tick is swept at once, only longer motion
+    // is split into parts that fit into the grid
+    int const num_parts = (longest > max_motion) ? (int)ceilf(longest / max_motion) : 1;
+
+    vec3 part_motion;
+    glm_vec3_scale(motion, 1.0f / num_parts, part_motion);
 
     ivec3 do_collide;
     my_glm_ivec3_set(do_collide, 1, 1, 1);
 
-    for (int i = 0; i < num_steps; i++)
-        collide_all_axes(p, step_motion, do_collide);
+    for (int i = 0; i < num_parts; i++)
+        sweep_all_axes(p, part_motion, do_collide);
 }
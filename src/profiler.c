@@ -0,0 +1,183 @@
+#include <profiler.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tinycthread.h>
+
+// Bundled tinycthread only maps _Thread_local for compilers before
+// C11 and has no thread_local, MSVC lacks the keyword in C11 mode too
+#if defined(_MSC_VER)
+    #define thread_local __declspec(thread)
+#elif !defined(thread_local)
+    #define thread_local _Thread_local
+#endif
+
+#define PROFILER_MAX_THREADS 64
+
+typedef struct
+{
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+}
+ProfilerZone;
+
+typedef struct
+{
+    ProfilerZone* zones;
+    uint64_t num_recorded;
+    
+    // Only owning thread writes, but export 
+    // can happen from any thread
+    mtx_t mtx;
+
+    char name[32];
+}
+ProfilerThread;
+
+typedef struct
+{
+    ProfilerThread threads[PROFILER_MAX_THREADS];
+    int num_threads;
+    mtx_t threads_mtx;
+
+    uint64_t start_ns;
+}
+Profiler;
+
+static Profiler* profiler = NULL;
+static thread_local ProfilerThread* curr_thread = NULL;
+
+void profiler_init()
+{
+    profiler = malloc(sizeof(Profiler));
+    profiler->num_threads = 0;
+    mtx_init(&profiler->threads_mtx, mtx_plain);
+    profiler->start_ns = time_get_ns();
+}
+
+// NULL if there's no space for another thread
+static ProfilerThread* get_curr_thread()
+{
+    if (curr_thread)
+        return curr_thread;
+
+    mtx_lock(&profiler->threads_mtx);
+    if (profiler->num_threads < PROFILER_MAX_THREADS)
+    {
+        int index = profiler->num_threads++;
+        ProfilerThread* t = &profiler->threads[index];
+
+        t->zones = malloc(PROFILER_RING_SIZE * sizeof(ProfilerZone));
+        t->num_recorded = 0;
+        mtx_init(&t->mtx, mtx_plain);
+        sprintf(t->name, "thread %d", index);
+
+        curr_thread = t;
+    }
+    mtx_unlock(&profiler->threads_mtx);
+
+    return curr_thread;
+}
+
+void profiler_set_thread_name(const char* name)
+{
+    if (!profiler)
+        return;
+
+    ProfilerThread* t = get_curr_thread();
+    if (!t)
+        return;
+
+    mtx_lock(&t->mtx);
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    mtx_unlock(&t->mtx);
+}
+
+void profiler_record_zone(const char* name, uint64_t start_ns, uint64_t end_ns)
+{
+    if (!profiler)
+        return;
+
+    ProfilerThread* t = get_curr_thread();
+    if (!t)
+        return;
+
+    mtx_lock(&t->mtx);
+    ProfilerZone* zone = &t->zones[t->num_recorded % PROFILER_RING_SIZE];
+    zone->name = name;
+    zone->start_ns = start_ns;
+    zone->end_ns = end_ns;
+    t->num_recorded++;
+    mtx_unlock(&t->mtx);
+}
+
+void profiler_export(const char* path)
+{
+    if (!profiler)
+        return;
+
+    FILE* f = fopen(path, "w");
+    if (!f)
+    {
+        fprintf(stderr, "Unable to open profiler trace file: %s\n", path);
+        return;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    int is_first = 1;
+
+    mtx_lock(&profiler->threads_mtx);
+    for (int i = 0; i < profiler->num_threads; i++)
+    {
+        ProfilerThread* t = &profiler->threads[i];
+        mtx_lock(&t->mtx);
+
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+                   "\"args\":{\"name\":\"%s\"}}", is_first ? "" : ",\n", i, t->name);
+        is_first = 0;
+
+        // Oldest zones are overwritten when ring is full
+        uint64_t first = 0;
+        if (t->num_recorded > PROFILER_RING_SIZE)
+            first = t->num_recorded - PROFILER_RING_SIZE;
+
+        for (uint64_t j = first; j < t->num_recorded; j++)
+        {
+            ProfilerZone* zone = &t->zones[j % PROFILER_RING_SIZE];
+
+            // Timestamps are in microseconds
+            double ts  = (double)(zone->start_ns - profiler->start_ns) / 1000.0;
+            double dur = (double)(zone->end_ns - zone->start_ns) / 1000.0;
+
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+                       "\"ts\":%.3f,\"dur\":%.3f}", zone->name, i, ts, dur);
+        }
+
+        mtx_unlock(&t->mtx);
+    }
+    mtx_unlock(&profiler->threads_mtx);
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    fprintf(stdout, "Profiler trace is saved to %s\n", path);
+}
+
+void profiler_free()
+{
+    if (!profiler)
+        return;
+
+    for (int i = 0; i < profiler->num_threads; i++)
+    {
+        free(profiler->threads[i].zones);
+        mtx_destroy(&profiler->threads[i].mtx);
+    }
+    mtx_destroy(&profiler->threads_mtx);
+
+    free(profiler);
+    profiler = NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+
+#include <config.h>
+#include <time_measure.h>
+
+// Measure time spent inside of a block of code. Every thread
+// stores its zones in its own ring buffer, so only last
+// PROFILER_RING_SIZE zones of each thread are kept.
+// When profiler is disabled, zone costs a single branch.
+//
+// PROFILER_ZONE_BEGIN("map_update");
+//     ...
+// PROFILER_ZONE_END();
+#define PROFILER_ZONE_BEGIN(NAME)                                         \
+{                                                                         \
+    const char* profiler_zone_name_ = NAME;                               \
+    uint64_t profiler_zone_start_ = PROFILER_ENABLED ? time_get_ns() : 0; \
+
+#define PROFILER_ZONE_END()                                             \
+    if (profiler_zone_start_)                                           \
+        profiler_record_zone(profiler_zone_name_, profiler_zone_start_, \
+                             time_get_ns());                            \
+}
+
+#define PROFILER_RING_SIZE (1 << 16)
+
+void profiler_init();
+
+// Name that will be shown in trace for calling thread
+void profiler_set_thread_name(const char* name);
+
+void profiler_record_zone(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+// Write zones of all threads in Chrome trace format, open
+// the file in chrome://tracing or https://ui.perfetto.dev
+void profiler_export(const char* path);
+
+void profiler_free();
+
+#endif
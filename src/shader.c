@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <texture.h>
 
@@ -12,9 +13,44 @@ GLuint shader_sun;
 GLuint shader_deferred1;
 GLuint shader_deferred2;
 GLuint shader_shadow;
+GLuint shader_shadow_depth;
 GLuint shader_pip;
 GLuint shader_handitem;
 
+#define MAX_SHADERS          16
+#define MAX_SHADER_UNIFORMS  32
+#define FRAME_DATA_BINDING   0
+
+typedef struct
+{
+    char name[64];
+    GLint location;
+}
+UniformLocation;
+
+// Locations of all active uniforms of a program,
+// resolved once right after linking
+typedef struct
+{
+    GLuint program;
+    UniformLocation uniforms[MAX_SHADER_UNIFORMS];
+    int num_uniforms;
+}
+UniformCache;
+
+static UniformCache uniform_caches[MAX_SHADERS];
+static int num_uniform_caches = 0;
+
+static GLuint frame_data_ubo;
+
+// Declaration of FrameData uniform block, inserted
+// into every shader right after #version line
+static char* frame_data_src;
+
+// Constants of C code that FrameData depends on,
+// inserted before frame_data_src
+static char frame_data_defines[64];
+
 static char* get_file_data(const char* path)
 {
     FILE* f = fopen(path, "rb");
@@ -42,8 +78,22 @@ static GLuint compile_shader(const char* path, GLenum shader_type)
     if (!shader_src)
         return 0;
 
+    // #version has to be the first line, so everything
+    // else is inserted after it. #line keeps line numbers
+    // in compile errors the same as in the file
+    char* version_end = strchr(shader_src, '\n');
+    const GLchar* sources[5] = 
+    {
+        shader_src, frame_data_defines, frame_data_src, "#line 2\n", 
+        version_end ? version_end + 1 : ""
+    };
+    GLint lengths[5] = 
+    {
+        version_end ? (GLint)(version_end - shader_src + 1) : -1, -1, -1, -1, -1
+    };
+
     GLuint shader_id = glCreateShader(shader_type);
-    glShaderSource(shader_id, 1, (const GLchar* const*)&shader_src, NULL);
+    glShaderSource(shader_id, 5, sources, lengths);
     glCompileShader(shader_id);
 
     free(shader_src);
@@ -63,6 +113,50 @@ static GLuint compile_shader(const char* path, GLenum shader_type)
     return shader_id;
 }
 
+static void cache_uniform_locations(GLuint shader_prog)
+{
+    if (num_uniform_caches == MAX_SHADERS)
+    {
+        fprintf(stderr, "Too many shader programs, uniform locations are not cached\n");
+        return;
+    }
+
+    UniformCache* cache = &uniform_caches[num_uniform_caches++];
+    cache->program = shader_prog;
+    cache->num_uniforms = 0;
+
+    GLint num_active;
+    glGetProgramiv(shader_prog, GL_ACTIVE_UNIFORMS, &num_active);
+
+    for (GLint i = 0; i < num_active; i++)
+    {
+        char name[64];
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(shader_prog, i, sizeof(name), NULL, &size, &type, name);
+
+        // Uniforms inside of blocks have no location
+        GLint location = glGetUniformLocation(shader_prog, name);
+        if (location == -1)
+            continue;
+
+        if (cache->num_uniforms == MAX_SHADER_UNIFORMS)
+        {
+            fprintf(stderr, "Too many uniforms in shader program, %s is not cached\n", name);
+            continue;
+        }
+
+        // Arrays are reported as "name[0]"
+        char* bracket = strchr(name, '[');
+        if (bracket)
+            *bracket = '\0';
+
+        UniformLocation* u = &cache->uniforms[cache->num_uniforms++];
+        strcpy(u->name, name);
+        u->location = location;
+    }
+}
+
 static GLuint create_shader_program(const char* vs_path, const char* fs_path)
 {
     GLuint vs_id = compile_shader(vs_path, GL_VERTEX_SHADER);
@@ -89,11 +183,30 @@ static GLuint create_shader_program(const char* vs_path, const char* fs_path)
     glDeleteShader(vs_id);
     glDeleteShader(fs_id);
 
+    GLuint block_index = glGetUniformBlockIndex(shader_prog, "FrameData");
+    if (block_index != GL_INVALID_INDEX)
+        glUniformBlockBinding(shader_prog, block_index, FRAME_DATA_BINDING);
+
+    cache_uniform_locations(shader_prog);
+
     return shader_prog;
 }
 
 void shaders_init()
 {
+    frame_data_src = get_file_data("shaders/frame_data.glsl");
+    if (!frame_data_src)
+        exit(-1);
+
+    snprintf(frame_data_defines, sizeof(frame_data_defines), 
+             "#define SHADOW_MAX_CASCADES %d\n", SHADOW_MAX_CASCADES);
+
+    glGenBuffers(1, &frame_data_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_data_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frame_data_ubo);
+
     shader_block = create_shader_program(
         "shaders/block_vertex.glsl",
         "shaders/block_fragment.glsl"
@@ -129,6 +242,11 @@ void shaders_init()
         "shaders/shadow_fragment.glsl"
     );
 
+    shader_shadow_depth = create_shader_program(
+        "shaders/shadow_depth_vertex.glsl",
+        "shaders/shadow_depth_fragment.glsl"
+    );
+
     shader_pip = create_shader_program(
         "shaders/pip_vertex.glsl",
         "shaders/pip_fragment.glsl"
@@ -138,14 +256,48 @@ void shaders_init()
         "shaders/handitem_vertex.glsl",
         "shaders/handitem_fragment.glsl"
     );
+
+    free(frame_data_src);
+    frame_data_src = NULL;
+}
+
+void shader_update_frame_data(FrameData* data)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_data_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+static UniformCache* get_uniform_cache(GLuint shader)
+{
+    // The same program is usually used many times in a row
+    static UniformCache* last = NULL;
+    if (last && last->program == shader)
+        return last;
+
+    for (int i = 0; i < num_uniform_caches; i++)
+    {
+        if (uniform_caches[i].program == shader)
+        {
+            last = &uniform_caches[i];
+            return last;
+        }
+    }
+    return NULL;
 }
 
 static GLint get_attrib_location(GLuint shader, char* name)
 {
-    GLint location = glGetUniformLocation(shader, name);
-    if (location == -1)
-       fprintf(stderr, "Shader attrib location is -1: %s\n", name);
-    return location;
+    UniformCache* cache = get_uniform_cache(shader);
+    if (cache)
+    {
+        for (int i = 0; i < cache->num_uniforms; i++)
+            if (strcmp(cache->uniforms[i].name, name) == 0)
+                return cache->uniforms[i].location;
+    }
+
+    fprintf(stderr, "Shader attrib location is -1: %s\n", name);
+    return -1;
 }
 
 void shader_set_int1(GLuint shader, char* name, int value)
@@ -202,6 +354,9 @@ static void shader_free(GLuint* shader)
 
 void shaders_free()
 {
+    glDeleteBuffers(1, &frame_data_ubo);
+    num_uniform_caches = 0;
+
     shader_free(&shader_block);
     shader_free(&shader_line);
     shader_free(&shader_skybox);
@@ -209,6 +364,7 @@ void shaders_free()
     shader_free(&shader_deferred1);
     shader_free(&shader_deferred2);
     shader_free(&shader_shadow);
+    shader_free(&shader_shadow_depth);
     shader_free(&shader_pip);
     shader_free(&shader_handitem);
 }
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include <glad/glad.h>
 #include <cglm/cglm.h>
 
+#include <config.h>
+
 // Global variables for other files to access
 extern GLuint shader_block;
 extern GLuint shader_line;
@@ -12,11 +14,41 @@ extern GLuint shader_sun;
 extern GLuint shader_deferred1;
 extern GLuint shader_deferred2;
 extern GLuint shader_shadow;
+extern GLuint shader_shadow_depth;
 extern GLuint shader_pip;
 extern GLuint shader_handitem;
 
+// Per-frame data shared by all shader programs through
+// uniform buffer. Layout must match shaders/frame_data.glsl
+typedef struct
+{
+    mat4  vp_matrix;
+    mat4  proj_matrix;
+    mat4  proj_inv_matrix;
+    mat4  view_inv_matrix;
+    mat4  prev_view_matrix;
+    mat4  shadowmap_mats[SHADOW_MAX_CASCADES];
+
+    vec3  cam_pos;
+    float time;
+    vec3  prev_cam_pos;
+    float dt;
+    vec3  light_dir;
+    float fog_dist;
+    vec3  fog_color;
+    float block_light;
+
+    float shadow_multiplier;
+    int   shadow_cascades;
+    float shadow_blend_dist;
+}
+FrameData;
+
 void shaders_init();
 
+// Upload data to the uniform buffer, call once per frame
+void shader_update_frame_data(FrameData* data);
+
 void shader_set_int1(GLuint shader, char* name, int value);
 
 void shader_set_float1(GLuint shader, char* name, float value);
@@ -220,6 +220,26 @@ GLuint framebuffer_depth_texture_create(int width, int height)
     return texture;
 }
 
+GLuint framebuffer_shadow_texture_array_create(int width, int layers)
+{
+    GLuint texture = texture_init(GL_TEXTURE_2D_ARRAY);
+
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, width, width, 
+                 layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+
+    // Everything outside of shadow map is lit
+    float const border_color[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border_color);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+
+    return texture;
+}
+
 void texture_2d_bind(GLuint texture, int slot)
 {
     glActiveTexture(GL_TEXTURE0 + slot);
@@ -17,6 +17,9 @@ GLuint framebuffer_color_texture_create(int width, int height);
 
 GLuint framebuffer_depth_texture_create(int width, int height);
 
+// Layered depth texture with comparison enabled, for shadow maps
+GLuint framebuffer_shadow_texture_array_create(int width, int layers);
+
 void texture_2d_bind(GLuint texture, int slot);
 
 void texture_array_bind(GLuint texture, int slot);
@@ -1,7 +1,9 @@
 #include <time_measure.h>
 
 #include <assert.h>
+#include <time.h>
 
+#include <utils.h>
 #include <GLFW/glfw3.h>
 
 static int no_last_time = 1;
@@ -26,3 +28,20 @@ double dt_get()
     assert(!no_last_time);
     return dt;
 }
+
+uint64_t time_get_ns()
+{
+#if defined(PLATFORM_WINDOWS)
+    static LARGE_INTEGER freq = {0};
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
@@ -1,8 +1,14 @@
 #ifndef TIME_MEASURE_H_
 #define TIME_MEASURE_H_
 
+#include <stdint.h>
+
 void dt_on_new_frame();
 
 double dt_get();
 
-#endif 
\ No newline at end of file
+// Monotonic time in nanoseconds since unspecified 
+// point, doesn't require GLFW to be initialized
+uint64_t time_get_ns();
+
+#endif
@@ -17,6 +17,10 @@
     #include "unistd.h"
 #endif
 
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
@@ -28,6 +32,9 @@ typedef struct
     float ao;
     unsigned char tile;
     unsigned char normal;
+
+    // Sky light in lower 4 bits, light of blocks in upper 4
+    unsigned char light;
 }
 Vertex;
 
@@ -65,6 +72,36 @@ static inline int thread_hardware_concurrency()
 #endif
 }
 
+// Atomic access to ints shared by main thread and workers
+static inline int atomic_load_int(volatile int* ptr)
+{
+#if defined(_MSC_VER)
+    return _InterlockedCompareExchange((volatile long*)ptr, 0, 0);
+#else
+    return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void atomic_store_int(volatile int* ptr, int value)
+{
+#if defined(_MSC_VER)
+    _InterlockedExchange((volatile long*)ptr, value);
+#else
+    __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// Set to desired only if it's equal to expected, 1 on success
+static inline int atomic_cas_int(volatile int* ptr, int expected, int desired)
+{
+#if defined(_MSC_VER)
+    return _InterlockedCompareExchange((volatile long*)ptr, desired, expected) == expected;
+#else
+    return __atomic_compare_exchange_n(ptr, &expected, desired, 0, 
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
 static inline void my_glm_vec3_set(vec3 vec, float f0, float f1, float f2)
 {
     vec[0] = f0;
@@ -6,6 +6,8 @@
 
 #include <config.h>
 #include <framebuffer.h>
+#include <gpu_timer.h>
+#include <map/chunk_pool.h>
 
 Window* g_window;
 
@@ -232,8 +234,15 @@ void window_update_title_fps()
     {
         int fps = (int)lroundf((float)num_frames / update_interval_secs);
 
-        char title[128];
-        sprintf(title, "%s - %d FPS", WINDOW_TITLE, fps);
+        char gpu_times[256];
+        gpu_timer_update_averages(gpu_times, sizeof(gpu_times));
+
+        ChunkPoolStats pool;
+        chunk_pool_get_stats(&pool);
+
+        char title[512];
+        sprintf(title, "%s - %d FPS%s | Chunks %d/%d", WINDOW_TITLE, fps, gpu_times, 
+                pool.num_used + pool.num_overflow, pool.capacity);
         glfwSetWindowTitle(g_window->glfw, title);
         
         num_frames = 0;
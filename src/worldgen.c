@@ -9,17 +9,6 @@
 
 static const int water_level = 50;
 
-typedef enum
-{
-    BIOME_PLAINS,
-    BIOME_FOREST,
-    BIOME_FLOWER_FOREST,
-    BIOME_MOUNTAINS, 
-    BIOME_DESERT,
-    BIOME_OCEAN
-}
-Biome;
-
 static Biome get_biome(noise_state* state, int bx, int bz)
 {
     // Voronoi noise
@@ -351,3 +340,35 @@ void worldgen_generate_chunk(Chunk* c)
 
     free(state);
 }
+
+Biome worldgen_get_biome(int bx, int bz)
+{
+    noise_state* state = noise_state_create(chunked_block(bx), chunked_block(bz));
+    Biome biome = get_biome(state, bx, bz);
+    free(state);
+    return biome;
+}
+
+void worldgen_get_surface(int bx, int bz, int* height, unsigned char* block)
+{
+    noise_state* state = noise_state_create(chunked_block(bx), chunked_block(bz));
+    Biome biome = get_biome(state, bx, bz);
+    int h = get_height(&state->fnl, biome, bx, bz);
+    free(state);
+
+    if (h < water_level)
+    {
+        *height = water_level;
+        *block = BLOCK_WATER;
+        return;
+    }
+
+    *height = h;
+    switch (biome)
+    {
+        case BIOME_MOUNTAINS: *block = h < 100 ? BLOCK_STONE : BLOCK_SNOW; break;
+        case BIOME_DESERT:    *block = BLOCK_SAND;  break;
+        case BIOME_OCEAN:     *block = BLOCK_SAND;  break;
+        default:              *block = BLOCK_GRASS; break;
+    }
+}
@@ -3,6 +3,28 @@
 
 #include <map/chunk.h>
 
+typedef enum
+{
+    BIOME_PLAINS,
+    BIOME_FOREST,
+    BIOME_FLOWER_FOREST,
+    BIOME_MOUNTAINS, 
+    BIOME_DESERT,
+    BIOME_OCEAN
+}
+Biome;
+
+#define BIOMES_AMOUNT (BIOME_OCEAN + 1)
+
 void worldgen_generate_chunk(Chunk* c);
 
+// Biome of the block column, uses current map seed
+Biome worldgen_get_biome(int bx, int bz);
+
+// Height and top block of the block column without generating
+// chunk. Height is taken right at the column, not interpolated,
+// trees and plants are ignored. Columns under water return
+// water surface
+void worldgen_get_surface(int bx, int bz, int* height, unsigned char* block);
+
 #endif